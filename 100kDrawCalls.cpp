@@ -1,223 +1,149 @@
-﻿#include <assert.h>
-#include <stdint.h>
-#include <math.h>
-#include <vector>
-#include <algorithm>
-#include <execution>
-#include <dxgi1_4.h>
-#include <d3d12.h>
+﻿#include "Backend.h"
+#include "Random.h"
+#include "FrameQueue.h"
+#include "Scene.h"
+#ifdef _WIN32
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-#include "d3dx12.h"
-#pragma comment(lib, "d3d12.lib")
-#pragma comment(lib, "dxgi.lib")
-
-#define VHR(hr) if (FAILED(hr)) { assert(0); }
-#define SAFE_RELEASE(obj) if ((obj)) { (obj)->Release(); (obj) = nullptr; }
-
-#define k_DemoName "100k Draw Calls in Parallel"
-#define k_DemoResolutionX 1280
-#define k_DemoResolutionY 720
+#endif
 
-struct Demo
+// Producer thread of -simthread, generates the draw data of the next frames into 'queue'.
+struct Simulation
 {
-    ID3D12Device* device;
-    ID3D12CommandQueue* cmdQueue;
-    ID3D12CommandAllocator* cmdAlloc[2];
-    ID3D12GraphicsCommandList* cmdList;
-    IDXGISwapChain3* swapChain;
-    ID3D12DescriptorHeap* swapBufferHeap;
-    D3D12_CPU_DESCRIPTOR_HANDLE swapBufferHeapStart;
-    ID3D12Resource* swapBuffers[4];
-    ID3D12Fence* frameFence;
-    HANDLE frameFenceEvent;
-    HWND window;
-    uint32_t descriptorSize;
-    uint32_t descriptorSizeRtv;
-    uint32_t frameIndex;
-    uint32_t backBufferIndex;
-    uint64_t frameCount;
-    ID3D12PipelineState* pso;
-    ID3D12RootSignature* rootSig;
+    FrameQueue queue;
+    std::thread thread;
+    std::atomic<bool> quit;
+    RandomStream stream;
+    // Producer totals: frames generated, time spent generating them and waiting for a free packet.
+    uint64_t numFrames;
+    double simulateTime;
+    double waitTime;
 };
 
-// returns [0.0f, 1.0f)
-static inline float
-Randomf()
-{
-    const uint32_t exponent = 127;
-    const uint32_t significand = (uint32_t)(rand() & 0x7fff); // get 15 random bits
-    const uint32_t result = (exponent << 23) | (significand << 8);
-    return *(float*)&result - 1.0f;
-}
-
-static inline float
-Randomf(float begin, float end)
-{
-    assert(begin < end);
-    return begin + (end - begin) * Randomf();
-}
-
-static std::vector<uint8_t>
-LoadFile(const char* fileName)
+struct Demo
 {
-    FILE* file = fopen(fileName, "rb");
-    assert(file);
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    assert(size != -1);
-    std::vector<uint8_t> content(size);
-    fseek(file, 0, SEEK_SET);
-    fread(&content[0], 1, content.size(), file);
-    fclose(file);
-    return content;
-}
+    Config config;
+    Backend* backend;
+    Workers workers;
+    RandomStream randomStreams[k_MaxNumThreads];
+    Scene scene;
+    Simulation simulation;
+};
 
+// Simulation thread: fills the next free packet as soon as there is one. The worker threads belong to the
+// render thread, the whole frame is generated here.
 static void
-InitializeDx12(Demo& demo)
+RunSimulation(Demo& demo, const Config& config)
 {
-    IDXGIFactory4* factory;
-#ifdef _DEBUG
-    VHR(CreateDXGIFactory2(DXGI_CREATE_FACTORY_DEBUG, IID_PPV_ARGS(&factory)));
-#else
-    VHR(CreateDXGIFactory2(0, IID_PPV_ARGS(&factory)));
-#endif
-
-#ifdef _DEBUG
-    {
-        ID3D12Debug* dbg;
-        D3D12GetDebugInterface(IID_PPV_ARGS(&dbg));
-        if (dbg)
-        {
-            dbg->EnableDebugLayer();
-            ID3D12Debug1* dbg1;
-            dbg->QueryInterface(IID_PPV_ARGS(&dbg1));
-            if (dbg1)
-                dbg1->SetEnableGPUBasedValidation(TRUE);
-            SAFE_RELEASE(dbg);
-            SAFE_RELEASE(dbg1);
-        }
-    }
-#endif
-    if (FAILED(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_1, IID_PPV_ARGS(&demo.device))))
+    Simulation& sim = demo.simulation;
+    while (!sim.quit.load(std::memory_order_relaxed))
     {
-        // #TODO: Add MessageBox
-        return;
-    }
-
-    D3D12_COMMAND_QUEUE_DESC cmdQueueDesc = {};
-    cmdQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-    cmdQueueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
-    cmdQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
-    VHR(demo.device->CreateCommandQueue(&cmdQueueDesc, IID_PPV_ARGS(&demo.cmdQueue)));
-
-    DXGI_SWAP_CHAIN_DESC swapChainDesc = {};
-    swapChainDesc.BufferCount = 4;
-    swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    swapChainDesc.OutputWindow = demo.window;
-    swapChainDesc.SampleDesc.Count = 1;
-    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
-    swapChainDesc.Windowed = TRUE;
-
-    IDXGISwapChain* tempSwapChain;
-    VHR(factory->CreateSwapChain(demo.cmdQueue, &swapChainDesc, &tempSwapChain));
-    VHR(tempSwapChain->QueryInterface(IID_PPV_ARGS(&demo.swapChain)));
-    SAFE_RELEASE(tempSwapChain);
-    SAFE_RELEASE(factory);
-
-    for (uint32_t i = 0; i < 2; ++i)
-        VHR(demo.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&demo.cmdAlloc[i])));
-
-    demo.descriptorSize = demo.device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    demo.descriptorSizeRtv = demo.device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-
-    /* swap buffers */ {
-        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-        heapDesc.NumDescriptors = 4;
-        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-        VHR(demo.device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&demo.swapBufferHeap)));
-        demo.swapBufferHeapStart = demo.swapBufferHeap->GetCPUDescriptorHandleForHeapStart();
-
-        CD3DX12_CPU_DESCRIPTOR_HANDLE handle(demo.swapBufferHeapStart);
-
-        for (uint32_t i = 0; i < 4; ++i)
+        const double waitBegin = GetTime();
+        FramePacket* packet = TryBeginWrite(sim.queue);
+        if (!packet)
         {
-            VHR(demo.swapChain->GetBuffer(i, IID_PPV_ARGS(&demo.swapBuffers[i])));
-
-            demo.device->CreateRenderTargetView(demo.swapBuffers[i], nullptr, handle);
-            handle.Offset(demo.descriptorSizeRtv);
+            std::this_thread::yield();
+            sim.waitTime += GetTime() - waitBegin;
+            continue;
         }
-    }
-
-    VHR(demo.device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, demo.cmdAlloc[0], nullptr, IID_PPV_ARGS(&demo.cmdList)));
-    VHR(demo.cmdList->Close());
 
-    VHR(demo.device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&demo.frameFence)));
-    demo.frameFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+        TRACE_ZONE("Simulate");
+        const double simulateBegin = GetTime();
+        GeneratePositions(sim.stream, GetRedundantDrawThreshold(config.redundancy), packet->positionX.data(),
+                          packet->positionY.data(), 0, config.numDraws);
+        packet->simulateTime = GetTime() - simulateBegin;
+        sim.simulateTime += packet->simulateTime;
+        sim.numFrames++;
+        EndWrite(sim.queue);
+    }
 }
 
 static void
-Shutdown(Demo& demo)
+StartSimulation(Demo& demo, const Config& config)
 {
-    SAFE_RELEASE(demo.cmdList);
-    SAFE_RELEASE(demo.cmdAlloc[0]);
-    SAFE_RELEASE(demo.cmdAlloc[1]);
-    SAFE_RELEASE(demo.swapBufferHeap);
-    for (int i = 0; i < 4; ++i)
-        SAFE_RELEASE(demo.swapBuffers[i]);
-    CloseHandle(demo.frameFenceEvent);
-    SAFE_RELEASE(demo.frameFence);
-    SAFE_RELEASE(demo.swapChain);
-    SAFE_RELEASE(demo.cmdQueue);
-    SAFE_RELEASE(demo.device);
+    Simulation& sim = demo.simulation;
+    InitializeFrameQueue(sim.queue, config.numDraws);
+    sim.quit.store(false, std::memory_order_relaxed);
+    sim.numFrames = 0;
+    sim.simulateTime = 0.0;
+    sim.waitTime = 0.0;
+    sim.thread = std::thread(RunSimulation, std::ref(demo), std::cref(config));
 }
 
+// Prints what the producer did per frame. 'renderWaitTime' is the average time the render thread waited for a
+// packet, 'hidden_ms' the part of the simulation that ran in parallel with rendering.
 static void
-Present(Demo& demo)
+StopSimulation(Demo& demo, double renderWaitTime)
 {
-    demo.swapChain->Present(0, 0);
-    demo.cmdQueue->Signal(demo.frameFence, ++demo.frameCount);
-
-    const uint64_t deviceFrameCount = demo.frameFence->GetCompletedValue();
-
-    if ((demo.frameCount - deviceFrameCount) >= 2)
-    {
-        demo.frameFence->SetEventOnCompletion(deviceFrameCount + 1, demo.frameFenceEvent);
-        WaitForSingleObject(demo.frameFenceEvent, INFINITE);
-    }
+    Simulation& sim = demo.simulation;
+    sim.quit.store(true, std::memory_order_relaxed);
+    sim.thread.join();
+
+    const double scale = 1.0 / std::max(1ull, (unsigned long long)sim.numFrames);
+    printf("simthread: packets=%u simulate_ms=%.3f sim_wait_ms=%.3f render_wait_ms=%.3f hidden_ms=%.3f\n",
+           k_NumFramePackets, sim.simulateTime * scale * 1000.0, sim.waitTime * scale * 1000.0,
+           renderWaitTime * 1000.0, std::max(0.0, sim.simulateTime * scale - renderWaitTime) * 1000.0);
+}
 
-    demo.frameIndex = !demo.frameIndex;
-    demo.backBufferIndex = demo.swapChain->GetCurrentBackBufferIndex();
+// Previous per-draw generator, kept for the comparison in RunRandomBenchmark().
+// returns [0.0f, 1.0f)
+static inline float
+RandomfCrt()
+{
+    const uint32_t exponent = 127;
+    const uint32_t significand = (uint32_t)(rand() & 0x7fff); // get 15 random bits
+    const uint32_t result = (exponent << 23) | (significand << 8);
+    return *(float*)&result - 1.0f;
 }
 
-static void
-Flush(Demo& demo)
+static inline float
+RandomfCrt(float begin, float end)
 {
-    demo.cmdQueue->Signal(demo.frameFence, ++demo.frameCount);
-    demo.frameFence->SetEventOnCompletion(demo.frameCount, demo.frameFenceEvent);
-    WaitForSingleObject(demo.frameFenceEvent, INFINITE);
+    assert(begin < end);
+    return begin + (end - begin) * RandomfCrt();
 }
 
-static double
-GetTime()
+// Compares per-frame cost of generating all positions with rand() (two calls per draw) and with FillRandom().
+static int
+RunRandomBenchmark(Demo& demo)
 {
-    static LARGE_INTEGER startCounter;
-    static LARGE_INTEGER frequency;
-    if (startCounter.QuadPart == 0)
+    const uint32_t numIterations = 200;
+    const uint32_t numDraws = demo.config.numDraws;
+    demo.scene.positionX.resize(numDraws);
+    demo.scene.positionY.resize(numDraws);
+    float* x = demo.scene.positionX.data();
+    float* y = demo.scene.positionY.data();
+    float checksum = 0.0f;
+
+    double t0 = GetTime();
+    for (uint32_t n = 0; n < numIterations; ++n)
     {
-        QueryPerformanceFrequency(&frequency);
-        QueryPerformanceCounter(&startCounter);
+        for (uint32_t i = 0; i < numDraws; ++i)
+        {
+            x[i] = RandomfCrt(-0.7f, 0.7f);
+            y[i] = RandomfCrt(-0.7f, 0.7f);
+        }
+        checksum += x[n] + y[n];
     }
-    LARGE_INTEGER counter;
-    QueryPerformanceCounter(&counter);
-    return (counter.QuadPart - startCounter.QuadPart) / (double)frequency.QuadPart;
+    const double crtMs = (GetTime() - t0) * 1000.0 / numIterations;
+
+    t0 = GetTime();
+    for (uint32_t n = 0; n < numIterations; ++n)
+    {
+        FillRandom(demo.randomStreams[0], x, numDraws, -0.7f, 0.7f);
+        FillRandom(demo.randomStreams[0], y, numDraws, -0.7f, 0.7f);
+        checksum += x[n] + y[n];
+    }
+    const double bulkMs = (GetTime() - t0) * 1000.0 / numIterations;
+
+    printf("rng: draws=%u rand_ms=%.3f fill_random_ms=%.3f (%s) saved_ms=%.3f speedup=%.1fx checksum=%.1f\n",
+           numDraws, crtMs, bulkMs, GetRandomIsaName(), crtMs - bulkMs, crtMs / bulkMs, checksum);
+    return 0;
 }
 
 static void
-UpdateFrameTime(HWND window, double& o_Time, double& o_DeltaTime)
+UpdateFrameTime(Backend* backend, double& o_Time, double& o_DeltaTime)
 {
     static double lastTime = -1.0;
     static double lastFpsTime = 0.0;
@@ -239,149 +165,600 @@ UpdateFrameTime(HWND window, double& o_Time, double& o_DeltaTime)
         const double ms = (1.0 / fps) * 1000.0;
         char text[256];
         snprintf(text, sizeof(text), "[%.1f fps  %.3f ms] %s", fps, ms, k_DemoName);
-        SetWindowText(window, text);
+        backend->SetStatusText(text);
         lastFpsTime = o_Time;
         frameCount = 0;
     }
     frameCount++;
 }
 
-static LRESULT CALLBACK
-ProcessWindowMessage(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
+// -backend NAME  dx12 (Windows default), vulkan, gl or null (default elsewhere)
+// -mode NAME     loop (default), mdi or mdicount (gl), executeindirect, instanced or bundle (dx12), rootcbv,
+//                table, rootsrv or sortkey (dx12, null)
+// -bundles K     bundle mode: split draws into K bundles recorded once at startup (default 1)
+// -threads N     record draws on N threads (0 means one per hardware thread, default 1)
+// -secondary     vulkan: record into secondary command buffers (always used with more than one thread)
+// -headless      render to offscreen textures, no window and no swap chain (vkd3d, CI)
+// -draws N       number of draws per frame (default 100000)
+// -frames N      exit after N measured frames (default: run until ESC, or 1000 frames when headless)
+// -warmup N      frames run before measuring starts (default 10)
+// -output FILE   write per-frame timings and min/median/p95/p99 to FILE (.csv, otherwise JSON)
+// -trace FILE    write CPU zones of every frame and thread to FILE (Chrome trace JSON)
+// -redundancy R  loop mode: fraction R (0-1) of the draws set the same PSO, root signature, topology and
+//                root constants as the previous draw
+// -statefilter   loop mode: drop redundant state changes while recording
+// -nosort        sortkey mode: record the draw packets in draw order instead of sorting them
+// -mergedraws    dx12, null, loop and sortkey modes: merge runs of draws with the same pipeline state, root
+//                signature and topology into instanced draws, root constants go to a per-instance buffer
+// -dynamic F     fraction F (0-1) of the scene's objects that move per frame (default 1: all positions are
+//                regenerated). Below 1 backends only rewrite per-draw data of objects that moved and dx12/null
+//                resubmit command lists whose draws haven't changed
+// -particles     every object of the scene has a velocity and bounces inside the position box; all positions
+//                are integrated every frame by a SIMD kernel on all threads (overrides -dynamic)
+// -simthread     generate the draw data of frame N + 1 on a producer thread while frame N is recorded, handed
+//                over through a lock-free queue of k_NumFramePackets preallocated packets
+// -jobsize N     dx12, null: record N draws per job, one command list per job, on a work-stealing scheduler
+//                (default 0: one draw range and command list per thread)
+// -framesinflight N  1-4 frames in flight (default 2), 0 runs all depths and reports how much each one
+//                    saves compared to 1 (no CPU/GPU overlap)
+// -bindings      run loop, rootcbv, table and rootsrv modes and compare per-draw cost of the root bindings
+// -sweep         run 1k, 10k, 100k, 1M and 10M draws and fit fixed + per-draw cost of Draw()
+// -sweepthreads  also sweep 1, 2, 4, ... up to -threads threads and fit the serial fraction
+// -pipelinecache FILE  dx12: pipeline library file (default PipelineCache.bin)
+// -nopipelinecache     dx12: always create pipelines from scratch
+// -startup       delete the pipeline cache, then compare Initialize() time with a cold and with a warm cache
+// -rngbench      compare rand() with the bulk SIMD generator and exit
+static void
+ParseCommandLine(Config& config, int argc, char** argv)
 {
-    switch (message)
+#ifdef _WIN32
+    config.backend = "dx12";
+#else
+    config.backend = "null";
+#endif
+    config.numThreads = 1;
+    config.numFramesInFlight = 2;
+    config.numDraws = k_NumDraws;
+    config.numBundles = 1;
+    config.pipelineCache = "PipelineCache.bin";
+    config.numWarmupFrames = 10;
+    config.dynamic = 1.0;
+
+    for (int i = 1; i < argc; ++i)
     {
-    case WM_DESTROY:
-        PostQuitMessage(0);
-        return 0;
-    case WM_KEYDOWN:
-        if (wparam == VK_ESCAPE)
+        if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc)
+        {
+            config.backend = argv[++i];
+        }
+        else if (strcmp(argv[i], "-mode") == 0 && i + 1 < argc)
+        {
+            config.mode = FindDrawMode(argv[++i]);
+            if (config.mode == DrawMode_Count)
+            {
+                fprintf(stderr, "Unknown mode: %s\n", argv[i]);
+                config.mode = DrawMode_Loop;
+            }
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            config.numThreads = (uint32_t)atoi(argv[++i]);
+            if (config.numThreads == 0)
+                config.numThreads = std::thread::hardware_concurrency();
+        }
+        else if (strcmp(argv[i], "-framesinflight") == 0 && i + 1 < argc)
+        {
+            config.numFramesInFlight = std::min((uint32_t)atoi(argv[++i]), (uint32_t)k_MaxNumFramesInFlight);
+        }
+        else if (strcmp(argv[i], "-draws") == 0 && i + 1 < argc)
+        {
+            config.numDraws = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-bundles") == 0 && i + 1 < argc)
+        {
+            config.numBundles = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+        {
+            config.numFrames = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc)
+        {
+            config.numWarmupFrames = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-output") == 0 && i + 1 < argc)
+        {
+            config.output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+        {
+            config.trace = argv[++i];
+        }
+        else if (strcmp(argv[i], "-redundancy") == 0 && i + 1 < argc)
+        {
+            config.redundancy = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-statefilter") == 0)
+        {
+            config.stateFilter = true;
+        }
+        else if (strcmp(argv[i], "-nosort") == 0)
+        {
+            config.noSort = true;
+        }
+        else if (strcmp(argv[i], "-mergedraws") == 0)
+        {
+            config.mergeDraws = true;
+        }
+        else if (strcmp(argv[i], "-dynamic") == 0 && i + 1 < argc)
+        {
+            config.dynamic = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-particles") == 0)
+        {
+            config.particles = true;
+        }
+        else if (strcmp(argv[i], "-simthread") == 0)
+        {
+            config.simThread = true;
+        }
+        else if (strcmp(argv[i], "-jobsize") == 0 && i + 1 < argc)
+        {
+            config.jobSize = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-headless") == 0)
+        {
+            config.headless = true;
+        }
+        else if (strcmp(argv[i], "-secondary") == 0)
+        {
+            config.secondary = true;
+        }
+        else if (strcmp(argv[i], "-pipelinecache") == 0 && i + 1 < argc)
+        {
+            config.pipelineCache = argv[++i];
+        }
+        else if (strcmp(argv[i], "-nopipelinecache") == 0)
+        {
+            config.pipelineCache = nullptr;
+        }
+        else if (strcmp(argv[i], "-startup") == 0)
         {
-            PostQuitMessage(0);
-            return 0;
+            config.compareStartup = true;
+        }
+        else if (strcmp(argv[i], "-bindings") == 0)
+        {
+            config.compareBindings = true;
+        }
+        else if (strcmp(argv[i], "-sweep") == 0)
+        {
+            config.sweep = true;
+        }
+        else if (strcmp(argv[i], "-sweepthreads") == 0)
+        {
+            config.sweep = true;
+            config.sweepThreads = true;
+        }
+        else if (strcmp(argv[i], "-rngbench") == 0)
+        {
+            config.randomBenchmark = true;
         }
-        break;
     }
-    return DefWindowProc(window, message, wparam, lparam);
+    config.numThreads = std::max(1u, std::min(config.numThreads, (uint32_t)k_MaxNumThreads));
+    // Only the D3D12 backend has a window. Comparisons and the sweep create several backends in a row, they run
+    // headless too.
+    if (strcmp(config.backend, "dx12") != 0 || config.numFramesInFlight == 0 || config.sweep ||
+        config.compareBindings || config.compareStartup)
+        config.headless = true;
+    if ((config.sweep || config.compareBindings || config.compareStartup) && config.numFramesInFlight == 0)
+        config.numFramesInFlight = 2;
+    if (config.sweep && config.numFrames == 0)
+        config.numFrames = 20;
+    if (strcmp(config.backend, "vulkan") == 0 && config.numThreads > 1)
+        config.secondary = true;
+    if (config.headless && config.numFrames == 0)
+        config.numFrames = 1000;
 }
 
-static void
-InitializeWindow(Demo& demo)
+static Backend*
+CreateBackend(const char* name)
 {
-    WNDCLASS winclass = {};
-    winclass.lpfnWndProc = ProcessWindowMessage;
-    winclass.hInstance = GetModuleHandle(nullptr);
-    winclass.hCursor = LoadCursor(nullptr, IDC_ARROW);
-    winclass.lpszClassName = k_DemoName;
-    if (!RegisterClass(&winclass))
-        assert(0);
-
-    RECT rect = { 0, 0, k_DemoResolutionX, k_DemoResolutionY };
-    if (!AdjustWindowRect(&rect, WS_OVERLAPPED | WS_SYSMENU | WS_CAPTION | WS_MINIMIZEBOX, 0))
-        assert(0);
-
-    demo.window = CreateWindowEx(
-        0, k_DemoName, k_DemoName, WS_OVERLAPPED | WS_SYSMENU | WS_CAPTION | WS_MINIMIZEBOX | WS_VISIBLE,
-        CW_USEDEFAULT, CW_USEDEFAULT,
-        rect.right - rect.left, rect.bottom - rect.top,
-        nullptr, nullptr, nullptr, 0);
-    assert(demo.window);
+    if (strcmp(name, "null") == 0)
+        return CreateNullBackend();
+#ifdef HAS_VULKAN
+    if (strcmp(name, "vulkan") == 0)
+        return CreateVulkanBackend();
+#endif
+#ifdef HAS_OPENGL
+    if (strcmp(name, "gl") == 0)
+        return CreateGlBackend();
+#endif
+#ifdef _WIN32
+    if (strcmp(name, "dx12") == 0)
+        return CreateDx12Backend();
+#endif
+    return nullptr;
 }
 
-static void
-Draw(Demo& demo)
+// Creates a backend for 'config', runs config.numWarmupFrames and then measures config.numFrames frames (or
+// until the window is closed).
+static bool
+RunBackend(Demo& demo, const Config& config, RunResults& o_Run)
 {
-    ID3D12CommandAllocator* cmdAlloc = demo.cmdAlloc[demo.frameIndex];
-    ID3D12GraphicsCommandList* cl = demo.cmdList;
+    const uint64_t memoryBegin = GetProcessMemoryUsage();
+    demo.backend = CreateBackend(config.backend);
+    if (!demo.backend)
+    {
+        fprintf(stderr, "Unknown backend: %s\n", config.backend);
+        return false;
+    }
+    if (!demo.backend->IsSupported(config.mode))
+    {
+        fprintf(stderr, "Backend %s does not support mode %s\n", config.backend, GetDrawModeName(config.mode));
+        delete demo.backend;
+        return false;
+    }
+    const double initBegin = GetTime();
+    if (!demo.backend->Initialize(config, &demo.workers))
+    {
+        fprintf(stderr, "Failed to initialize backend: %s\n", config.backend);
+        delete demo.backend;
+        return false;
+    }
 
-    cmdAlloc->Reset();
-    cl->Reset(cmdAlloc, nullptr);
+    o_Run.config = config;
+    o_Run.initTime = GetTime() - initBegin;
+    o_Run.frames.clear();
+    o_Run.frames.reserve(config.numFrames);
 
-    cl->RSSetViewports(1, &CD3DX12_VIEWPORT(0.0f, 0.0f, (float)k_DemoResolutionX, (float)k_DemoResolutionY));
-    cl->RSSetScissorRects(1, &CD3DX12_RECT(0, 0, k_DemoResolutionX, k_DemoResolutionY));
+    if (config.simThread)
+        StartSimulation(demo, config);
+    else
+        InitializeScene(demo.scene, config, demo.workers, demo.randomStreams);
 
-    cl->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(demo.swapBuffers[demo.backBufferIndex],
-                                                                 D3D12_RESOURCE_STATE_PRESENT,
-                                                                 D3D12_RESOURCE_STATE_RENDER_TARGET));
+    const uint64_t numFrames = (uint64_t)config.numWarmupFrames + config.numFrames;
+    for (uint64_t frame = 0; config.numFrames == 0 || frame < numFrames; ++frame)
+    {
+        TRACE_ZONE(frame < config.numWarmupFrames ? "Warmup frame" : "Frame");
+#ifdef PROFILE_COMMAND_LISTS
+        if (frame == config.numWarmupFrames)
+            ResetCommandListProfile();
+#endif
+        if (!demo.backend->ProcessEvents())
+            break;
+
+        double time, deltaTime;
+        UpdateFrameTime(demo.backend, time, deltaTime);
+
+        // With the simulation thread, update is only the time spent waiting for its packet.
+        FrameTimings timings = {};
+        FramePacket* packet = nullptr;
+        const uint64_t* dirty = nullptr;
+        const double updateBegin = GetTime();
+        if (config.simThread)
+        {
+            TRACE_ZONE("Wait for simulation");
+            while (!(packet = TryBeginRead(demo.simulation.queue)))
+                std::this_thread::yield();
+        }
+        else
+        {
+            TRACE_ZONE("Update");
+            dirty = UpdateScene(demo.scene, demo.workers);
+        }
+        timings.update = GetTime() - updateBegin;
+
+        FrameData frameData = {};
+        frameData.numDraws = config.numDraws;
+        frameData.positionX = packet ? packet->positionX.data() : demo.scene.positionX.data();
+        frameData.positionY = packet ? packet->positionY.data() : demo.scene.positionY.data();
+        frameData.redundantDrawThreshold = GetRedundantDrawThreshold(config.redundancy);
+        frameData.dirty = dirty;
+
+        /* draw */ {
+            TRACE_ZONE("Draw()");
+            demo.backend->Draw(frameData, timings);
+        }
+        // Backends are done with the frame data when Draw() returns.
+        if (packet)
+            EndRead(demo.simulation.queue);
+        const double presentBegin = GetTime();
+        /* present */ {
+            TRACE_ZONE("Present()");
+            demo.backend->Present(timings);
+        }
+        timings.present = GetTime() - presentBegin;
+        if (frame >= config.numWarmupFrames)
+            o_Run.frames.push_back(timings);
+    }
+
+    if (config.simThread)
+        StopSimulation(demo, o_Run.frames.empty() ? 0.0 : GetAverageTimings(o_Run.frames).update);
+    else
+        PrintSceneStats(demo.scene);
+#ifdef PROFILE_COMMAND_LISTS
+    PrintCommandListProfile((uint32_t)o_Run.frames.size());
+#endif
+    o_Run.commandMemorySize = demo.backend->GetCommandMemorySize();
+    o_Run.processMemoryGrowth = (int64_t)(GetProcessMemoryUsage() - memoryBegin);
+
+    demo.backend->Flush();
+    demo.backend->Shutdown();
+    delete demo.backend;
+    demo.backend = nullptr;
+    return true;
+}
 
-    D3D12_CPU_DESCRIPTOR_HANDLE backBufferDescriptor = CD3DX12_CPU_DESCRIPTOR_HANDLE(demo.swapBufferHeapStart,
-                                                                                     demo.backBufferIndex,
-                                                                                     demo.descriptorSizeRtv);
-    const float clearColor[4] = { 0.0f, 0.2f, 0.4f, 1.0f };
+// Runs the same workload with 1 to 4 frames in flight. With one frame in flight CPU and GPU never overlap,
+// 'overlap_ms' is the frame time each deeper queue saves compared to that.
+static bool
+CompareFramesInFlight(Demo& demo, std::vector<RunResults>& o_Runs)
+{
+    FrameTimings averages[k_MaxNumFramesInFlight] = {};
+
+    for (uint32_t depth = 1; depth <= k_MaxNumFramesInFlight; ++depth)
+    {
+        Config config = demo.config;
+        config.numFramesInFlight = depth;
+        RunResults run;
+        if (!RunBackend(demo, config, run))
+            return false;
+        PrintResults(config, run.frames);
+        averages[depth - 1] = GetAverageTimings(run.frames);
+        o_Runs.push_back(std::move(run));
+    }
 
-    cl->OMSetRenderTargets(1, &backBufferDescriptor, 0, nullptr);
-    cl->ClearRenderTargetView(backBufferDescriptor, clearColor, 0, nullptr);
+    const double serialFrameTime = GetFrameTime(averages[0]);
+    for (uint32_t depth = 1; depth <= k_MaxNumFramesInFlight; ++depth)
+    {
+        const FrameTimings& average = averages[depth - 1];
+        const double frameTime = GetFrameTime(average);
+        printf("frames_in_flight=%u frame_ms=%.3f wait_ms=%.3f overlap_ms=%.3f overlap_pct=%.1f\n", depth,
+               frameTime * 1000.0, average.wait * 1000.0, (serialFrameTime - frameTime) * 1000.0,
+               serialFrameTime > 0.0 ? (serialFrameTime - frameTime) / serialFrameTime * 100.0 : 0.0);
+    }
+    return true;
+}
 
-    cl->SetPipelineState(demo.pso);
-    cl->SetGraphicsRootSignature(demo.rootSig);
-    cl->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+// Initializes the backend twice, the first time without a pipeline cache on disk (it is deleted) and the
+// second time with the cache the first run has written.
+static bool
+CompareStartup(Demo& demo, std::vector<RunResults>& o_Runs)
+{
+    Config config = demo.config;
+    config.numWarmupFrames = 0;
+    config.numFrames = 1;
+    if (config.pipelineCache)
+        remove(config.pipelineCache);
 
-    for (uint32_t i = 0; i < 100000; ++i)
+    double initTimes[2];
+    for (uint32_t i = 0; i < 2; ++i)
     {
-        float p[2] = { Randomf(-0.7f, 0.7f), Randomf(-0.7f, 0.7f) };
-        cl->SetGraphicsRoot32BitConstants(0, 2, p, 0);
-        cl->DrawInstanced(1, 1, 0, 0);
+        RunResults run;
+        if (!RunBackend(demo, config, run))
+            return false;
+        initTimes[i] = run.initTime;
+        o_Runs.push_back(std::move(run));
     }
-    cl->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(demo.swapBuffers[demo.backBufferIndex],
-                                                                 D3D12_RESOURCE_STATE_RENDER_TARGET,
-                                                                 D3D12_RESOURCE_STATE_PRESENT));
-    VHR(cl->Close());
 
-    demo.cmdQueue->ExecuteCommandLists(1, (ID3D12CommandList**)&cl);
+    printf("startup: backend=%s mode=%s pipeline_cache=%s cold_init_ms=%.3f warm_init_ms=%.3f saved_ms=%.3f\n",
+           config.backend, GetDrawModeName(config.mode), config.pipelineCache ? config.pipelineCache : "none",
+           initTimes[0] * 1000.0, initTimes[1] * 1000.0, (initTimes[0] - initTimes[1]) * 1000.0);
+    return true;
 }
 
+// Runs the same workload with every root parameter binding model and prints CPU cost per draw of each.
+static bool
+CompareBindings(Demo& demo, std::vector<RunResults>& o_Runs)
+{
+    const uint32_t numBindings = 4;
+    static const DrawMode modes[numBindings] =
+    {
+        DrawMode_Loop, DrawMode_RootCbv, DrawMode_DescriptorTable, DrawMode_RootSrvIndex
+    };
+    static const char* bindingNames[numBindings] =
+    {
+        "root_constants", "root_cbv", "descriptor_table", "root_srv_index"
+    };
+    double recordTimes[numBindings] = {};
+
+    for (uint32_t i = 0; i < numBindings; ++i)
+    {
+        Config config = demo.config;
+        config.mode = modes[i];
+        RunResults run;
+        if (!RunBackend(demo, config, run))
+            continue;
+        PrintResults(config, run.frames);
+        recordTimes[i] = GetAverageTimings(run.frames).record;
+        o_Runs.push_back(std::move(run));
+    }
+
+    for (uint32_t i = 0; i < numBindings; ++i)
+    {
+        if (recordTimes[i] == 0.0)
+            continue;
+        printf("binding: %s mode=%s record_ns_per_draw=%.2f", bindingNames[i], GetDrawModeName(modes[i]),
+               recordTimes[i] * 1e9 / demo.config.numDraws);
+        if (recordTimes[0] > 0.0)
+            printf(" vs_root_constants=%.2fx", recordTimes[i] / recordTimes[0]);
+        printf("\n");
+    }
+    return !o_Runs.empty();
+}
+
+static const uint32_t s_SweepDrawCounts[] = { 1000, 10000, 100000, 1000000, 10000000 };
+#define k_NumSweepDrawCounts (sizeof(s_SweepDrawCounts) / sizeof(s_SweepDrawCounts[0]))
+
+// Least squares fit of time = fixed + perDraw * draws. Both sides are divided by draws (time per draw =
+// perDraw + fixed / draws) so every draw count is weighted by its relative error, otherwise 10M draws would
+// decide everything.
 static void
-Initialize(Demo& demo)
+FitDrawCost(const double* numDraws, const double* times, uint32_t count, double& o_Fixed, double& o_PerDraw)
 {
-    /* pso */ {
-        std::vector<uint8_t> vsCode = LoadFile("VsTransform.cso");
-        std::vector<uint8_t> psCode = LoadFile("PsShade.cso");
-
-        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-        psoDesc.VS = { vsCode.data(), vsCode.size() };
-        psoDesc.PS = { psCode.data(), psCode.size() };
-        psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-        psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-        psoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-        psoDesc.SampleMask = 0xffffffff;
-        psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-        psoDesc.NumRenderTargets = 1;
-        psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-        psoDesc.SampleDesc.Count = 1;
-
-        VHR(demo.device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&demo.pso)));
-        VHR(demo.device->CreateRootSignature(0, vsCode.data(), vsCode.size(), IID_PPV_ARGS(&demo.rootSig)));
+    double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const double x = 1.0 / numDraws[i];
+        const double y = times[i] / numDraws[i];
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
     }
+    const double denominator = count * sumXX - sumX * sumX;
+    o_Fixed = denominator != 0.0 ? (count * sumXY - sumX * sumY) / denominator : 0.0;
+    o_PerDraw = (sumY - o_Fixed * sumX) / count;
 }
 
-int CALLBACK
-WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
+// Amdahl's law: perDraw(n) / perDraw(1) = s + (1 - s) / n. Least squares fit of the serial fraction 's'.
+static double
+FitSerialFraction(const uint32_t* numThreads, const double* perDraw, uint32_t count)
 {
-    SetProcessDPIAware();
+    double numerator = 0.0, denominator = 0.0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const double x = 1.0 / numThreads[i];
+        const double y = perDraw[i] / perDraw[0];
+        numerator += (1.0 - x) * (y - x);
+        denominator += (1.0 - x) * (1.0 - x);
+    }
+    return denominator > 0.0 ? std::min(std::max(numerator / denominator, 0.0), 1.0) : 1.0;
+}
 
-    Demo demo = {};
-    InitializeWindow(demo);
-    InitializeDx12(demo);
-    Initialize(demo);
+// Runs Draw() at every draw count in s_SweepDrawCounts (and every thread count with -sweepthreads) and prints
+// fixed and per-draw cost of Draw() (record + submit), command memory at each size and the serial fraction.
+static bool
+SweepDrawCounts(Demo& demo, std::vector<RunResults>& o_Runs)
+{
+    const Config baseConfig = demo.config;
 
-    for (;;)
+    std::vector<uint32_t> threadCounts;
+    if (baseConfig.sweepThreads)
     {
-        MSG msg = {};
-        if (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
-        {
-            DispatchMessage(&msg);
-            if (msg.message == WM_QUIT)
-                break;
-        }
-        else
+        for (uint32_t n = 1; n < baseConfig.numThreads; n *= 2)
+            threadCounts.push_back(n);
+    }
+    threadCounts.push_back(baseConfig.numThreads);
+
+    std::vector<double> perDraw;
+    for (uint32_t numThreads : threadCounts)
+    {
+        StopWorkers(demo.workers);
+        StartWorkers(demo.workers, numThreads);
+
+        double numDraws[k_NumSweepDrawCounts], drawTimes[k_NumSweepDrawCounts];
+        for (uint32_t i = 0; i < k_NumSweepDrawCounts; ++i)
         {
-            double time, deltaTime;
-            UpdateFrameTime(demo.window, time, deltaTime);
-            Draw(demo);
-            Present(demo);
+            demo.config.numThreads = numThreads;
+            demo.config.numDraws = s_SweepDrawCounts[i];
+
+            RunResults run;
+            if (!RunBackend(demo, demo.config, run))
+                return false;
+            PrintResults(run.config, run.frames);
+
+            const FrameTimings average = GetAverageTimings(run.frames);
+            numDraws[i] = s_SweepDrawCounts[i];
+            drawTimes[i] = average.record + average.submit;
+            printf("sweep: threads=%u draws=%u draw_ms=%.3f command_memory_mb=%.2f process_memory_mb=%.2f\n",
+                   numThreads, s_SweepDrawCounts[i], drawTimes[i] * 1000.0,
+                   run.commandMemorySize / (1024.0 * 1024.0), run.processMemoryGrowth / (1024.0 * 1024.0));
+            o_Runs.push_back(std::move(run));
         }
+
+        double fixed, cost;
+        FitDrawCost(numDraws, drawTimes, k_NumSweepDrawCounts, fixed, cost);
+        printf("fit: backend=%s mode=%s threads=%u fixed_us=%.2f ns_per_draw=%.3f\n", baseConfig.backend,
+               GetDrawModeName(baseConfig.mode), numThreads, fixed * 1e6, cost * 1e9);
+        perDraw.push_back(cost);
     }
 
-    return 0;
+    if (threadCounts.size() > 1)
+    {
+        const double serialFraction = FitSerialFraction(threadCounts.data(), perDraw.data(),
+                                                        (uint32_t)threadCounts.size());
+        printf("fit: backend=%s mode=%s serial_fraction=%.3f max_speedup=%.1fx\n", baseConfig.backend,
+               GetDrawModeName(baseConfig.mode), serialFraction,
+               serialFraction > 0.0 ? 1.0 / serialFraction : (double)k_MaxNumThreads);
+    }
+
+    demo.config = baseConfig;
+    return true;
 }
+
+static int
+Run(int argc, char** argv)
+{
+    Demo demo = {};
+    ParseCommandLine(demo.config, argc, argv);
+
+    for (uint32_t t = 0; t < k_MaxNumThreads; ++t)
+        SeedRandom(demo.randomStreams[t], 0x1000ddull + t);
+    SeedRandom(demo.simulation.stream, 0x51a1ull);
+    if (demo.config.randomBenchmark)
+        return RunRandomBenchmark(demo);
+
+    if (demo.config.trace)
+        EnableTrace();
+    StartWorkers(demo.workers, demo.config.numThreads);
+
+    bool result;
+    std::vector<RunResults> runs;
+    if (demo.config.sweep)
+    {
+        result = SweepDrawCounts(demo, runs);
+    }
+    else if (demo.config.compareStartup)
+    {
+        result = CompareStartup(demo, runs);
+    }
+    else if (demo.config.compareBindings)
+    {
+        result = CompareBindings(demo, runs);
+    }
+    else if (demo.config.numFramesInFlight == 0)
+    {
+        result = CompareFramesInFlight(demo, runs);
+    }
+    else
+    {
+        runs.resize(1);
+        result = RunBackend(demo, demo.config, runs[0]);
+        PrintResults(demo.config, runs[0].frames);
+    }
+
+    if (result && demo.config.output && !WriteResults(demo.config.output, runs))
+    {
+        fprintf(stderr, "Failed to write results: %s\n", demo.config.output);
+        result = false;
+    }
+    if (demo.config.trace && !WriteTrace(demo.config.trace))
+    {
+        fprintf(stderr, "Failed to write trace: %s\n", demo.config.trace);
+        result = false;
+    }
+
+    StopWorkers(demo.workers);
+    return result ? 0 : 1;
+}
+
+#ifdef _WIN32
+int CALLBACK
+WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
+{
+    SetProcessDPIAware();
+
+    // Make printf() visible when started from a console.
+    if (AttachConsole(ATTACH_PARENT_PROCESS))
+        freopen("CONOUT$", "w", stdout);
+
+    return Run(__argc, __argv);
+}
+#else
+int
+main(int argc, char** argv)
+{
+    return Run(argc, argv);
+}
+#endif
 // vim: set ts=4 sw=4 expandtab:
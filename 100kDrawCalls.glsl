@@ -0,0 +1,28 @@
+#version 450
+
+// GLSL version of 100kDrawCalls.hlsl for the Vulkan backend. Root constants (b0) become push constants.
+
+#if defined VS_TRANSFORM
+
+layout(push_constant) uniform PushConstants
+{
+    vec2 position;
+} s_Pc;
+
+void main()
+{
+    gl_Position = vec4(s_Pc.position, 0.0, 1.0);
+    gl_PointSize = 1.0;
+}
+
+#elif defined PS_SHADE
+
+layout(location = 0) out vec4 o_Color;
+
+void main()
+{
+    o_Color = vec4(1.0, 1.0, 1.0, 1.0);
+}
+
+#endif
+// vim: set ts=4 sw=4 expandtab:
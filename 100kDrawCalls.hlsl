@@ -1,12 +1,31 @@
+// The third constant is the material of sort key mode, the shaders don't read it.
 #define RootSig \
-    "RootConstants(b0, num32BitConstants = 2)"
+    "RootConstants(b0, num32BitConstants = 3)"
+
+#define RootSigCbv \
+    "CBV(b0, visibility = SHADER_VISIBILITY_VERTEX)"
+
+#define RootSigInstanced \
+    "SRV(t0, visibility = SHADER_VISIBILITY_VERTEX)"
+
+#define RootSigTable \
+    "DescriptorTable(CBV(b0), visibility = SHADER_VISIBILITY_VERTEX)"
+
+#define RootSigIndexed \
+    "RootConstants(b0, num32BitConstants = 1), " \
+    "SRV(t0, visibility = SHADER_VISIBILITY_VERTEX)"
+
+// Draws merged by DrawMergeCommandList: first instance of the run, instance buffer.
+#define RootSigMerged \
+    "RootConstants(b0, num32BitConstants = 1), " \
+    "SRV(t0, visibility = SHADER_VISIBILITY_VERTEX)"
 
 struct PsData
 {
     float4 position : SV_Position;
 };
 
-#if defined VS_TRANSFORM
+#if defined VS_TRANSFORM || defined VS_TRANSFORM_CBV || defined VS_TRANSFORM_TABLE
 
 struct CbData
 {
@@ -14,7 +33,14 @@ struct CbData
 };
 ConstantBuffer<CbData> s_Cb : register(b0);
 
+// Same shader, constants come from root constants, a root CBV or a descriptor table.
+#if defined VS_TRANSFORM_CBV
+[RootSignature(RootSigCbv)]
+#elif defined VS_TRANSFORM_TABLE
+[RootSignature(RootSigTable)]
+#else
 [RootSignature(RootSig)]
+#endif
 PsData VsTransform()
 {
     PsData output;
@@ -22,6 +48,61 @@ PsData VsTransform()
     return output;
 }
 
+#elif defined VS_TRANSFORM_INSTANCED
+
+StructuredBuffer<float2> s_Positions : register(t0);
+
+[RootSignature(RootSigInstanced)]
+PsData VsTransformInstanced(uint instanceId : SV_InstanceID)
+{
+    PsData output;
+    output.position = float4(s_Positions[instanceId], 0.0f, 1.0f);
+    return output;
+}
+
+#elif defined VS_TRANSFORM_INDEXED
+
+// Only the draw index is set per draw (bundle and root SRV modes). Positions are read from this frame's part
+// of the position buffer.
+struct CbData
+{
+    uint drawIndex;
+};
+ConstantBuffer<CbData> s_Cb : register(b0);
+StructuredBuffer<float2> s_Positions : register(t0);
+
+[RootSignature(RootSigIndexed)]
+PsData VsTransformIndexed()
+{
+    PsData output;
+    output.position = float4(s_Positions[s_Cb.drawIndex], 0.0f, 1.0f);
+    return output;
+}
+
+#elif defined VS_TRANSFORM_MERGED
+
+// Every instance carries the root constants of the draw it was merged from. SV_InstanceID doesn't include the
+// start instance, the run's first instance is a root constant.
+struct MergedInstance
+{
+    float2 position;
+    uint material;
+};
+struct CbData
+{
+    uint firstInstance;
+};
+ConstantBuffer<CbData> s_Cb : register(b0);
+StructuredBuffer<MergedInstance> s_Instances : register(t0);
+
+[RootSignature(RootSigMerged)]
+PsData VsTransformMerged(uint instanceId : SV_InstanceID)
+{
+    PsData output;
+    output.position = float4(s_Instances[s_Cb.firstInstance + instanceId].position, 0.0f, 1.0f);
+    return output;
+}
+
 #elif defined PS_SHADE
 
 [RootSignature(RootSig)]
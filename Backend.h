@@ -0,0 +1,194 @@
+#pragma once
+#include "Common.h"
+#include "UploadRing.h"
+#include "Trace.h"
+#include "CommandListProfiler.h"
+#include "StateFilter.h"
+#include "DrawSort.h"
+#include "DrawMerge.h"
+#include "Jobs.h"
+
+// Frame-level interface implemented by every rendering backend. Demo owns one backend and drives it with
+// Draw() and Present() once per frame. Worker threads are owned by Demo and shared with the backend.
+struct Backend
+{
+    virtual ~Backend() {}
+    virtual bool IsSupported(DrawMode mode) { return mode == DrawMode_Loop; }
+    virtual bool Initialize(const Config& config, Workers* workers) = 0;
+    virtual void Shutdown() = 0;
+    // Returns false when the user asked to quit.
+    virtual bool ProcessEvents() { return true; }
+    virtual void SetStatusText(const char* text) { printf("%s\n", text); }
+    // Records and submits draws for 'frame'. Fills timings.record and timings.submit.
+    virtual void Draw(const FrameData& frame, FrameTimings& timings) = 0;
+    // Fills timings.wait with the time spent waiting for a frame in flight to complete and timings.gpu* with the
+    // GPU times of the latest completed frame.
+    virtual void Present(FrameTimings& timings) = 0;
+    // Waits until the device has finished all submitted work.
+    virtual void Flush() = 0;
+    // Bytes of command memory the backend can account for (command allocators, indirect argument and upload
+    // buffers). Memory owned by the driver is not included, 0 if unknown.
+    virtual uint64_t GetCommandMemorySize() { return 0; }
+};
+
+// Timestamps written by the GPU every frame, in this order.
+enum GpuTimestamp
+{
+    GpuTimestamp_FrameBegin,
+    GpuTimestamp_ClearEnd,
+    GpuTimestamp_DrawsEnd,
+    GpuTimestamp_FrameEnd,
+    GpuTimestamp_Count
+};
+
+// Fills the gpu* timings from one frame's timestamps.
+static inline void
+SetGpuTimings(FrameTimings& timings, const uint64_t ticks[GpuTimestamp_Count], double ticksPerSecond)
+{
+    timings.gpuClear = (ticks[GpuTimestamp_ClearEnd] - ticks[GpuTimestamp_FrameBegin]) / ticksPerSecond;
+    timings.gpuDraws = (ticks[GpuTimestamp_DrawsEnd] - ticks[GpuTimestamp_ClearEnd]) / ticksPerSecond;
+    timings.gpuFrame = (ticks[GpuTimestamp_FrameEnd] - ticks[GpuTimestamp_FrameBegin]) / ticksPerSecond;
+}
+
+// Incremental recording (-dynamic below 1): in these modes a command list depends only on the draw data of the
+// frame in flight it was recorded for, when none of its draws is dirty it can be submitted again as recorded.
+// The first and the last command list of a frame are always recorded, they carry the frame's clear, barriers
+// and timestamps.
+static inline bool
+CanReuseCommandList(DrawMode mode, const FrameData& frame, uint32_t cmdListIndex, uint32_t numCmdLists,
+                    uint32_t begin, uint32_t end)
+{
+    return (mode == DrawMode_Loop || mode == DrawMode_DescriptorTable || mode == DrawMode_RootSrvIndex) &&
+           cmdListIndex != 0 && cmdListIndex != numCmdLists - 1 && !IsDrawRangeDirty(frame.dirty, begin, end);
+}
+
+Backend* CreateNullBackend();
+#ifdef HAS_VULKAN
+Backend* CreateVulkanBackend();
+#endif
+#ifdef HAS_OPENGL
+Backend* CreateGlBackend();
+#endif
+#ifdef _WIN32
+Backend* CreateDx12Backend();
+#endif
+
+// Hot loop shared by all backends that expose D3D12-style command lists (ID3D12GraphicsCommandList,
+// NullCommandList, VulkanCommandList and GlCommandList).
+template <typename CommandList>
+static inline void
+RecordDraws(CommandList* cl, const FrameData& frame, uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        float p[2] = { frame.positionX[i], frame.positionY[i] };
+        cl->SetGraphicsRoot32BitConstants(0, 2, p, 0);
+        cl->DrawInstanced(1, 1, 0, 0);
+    }
+}
+
+// RecordDraws() for a workload with redundant state: redundant draws (IsRedundantDraw()) set 'pso', 'rootSig'
+// and 'topology' again, the state BeginCommandList() has set, and their constants equal those of the previous
+// draw.
+template <typename CommandList, typename PipelineState, typename RootSignature, typename Topology>
+static inline void
+RecordDrawsRedundant(CommandList* cl, PipelineState pso, RootSignature rootSig, Topology topology,
+                     const FrameData& frame, uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (IsRedundantDraw(i, frame.redundantDrawThreshold))
+        {
+            cl->SetPipelineState(pso);
+            cl->SetGraphicsRootSignature(rootSig);
+            cl->IASetPrimitiveTopology(topology);
+        }
+        float p[2] = { frame.positionX[i], frame.positionY[i] };
+        cl->SetGraphicsRoot32BitConstants(0, 2, p, 0);
+        cl->DrawInstanced(1, 1, 0, 0);
+    }
+}
+
+// Loop mode recording. With redundant draws in the workload and 'filter' set, calls go through a
+// StateFilterCommandList that drops the redundant ones.
+template <typename CommandList, typename PipelineState, typename RootSignature, typename Topology>
+static inline void
+RecordDrawsFiltered(CommandList* cl, bool filter, PipelineState pso, RootSignature rootSig, Topology topology,
+                    const FrameData& frame, uint32_t begin, uint32_t end)
+{
+    if (frame.redundantDrawThreshold == 0)
+    {
+        RecordDraws(cl, frame, begin, end);
+    }
+    else if (filter)
+    {
+        StateFilterCommandList<CommandList, PipelineState, RootSignature, Topology> filtered;
+        filtered.Reset(cl, pso, rootSig, topology);
+        RecordDrawsRedundant(&filtered, pso, rootSig, topology, frame, begin, end);
+    }
+    else
+    {
+        RecordDrawsRedundant(cl, pso, rootSig, topology, frame, begin, end);
+    }
+}
+
+// Same as RecordDraws() but constants of every draw are written into memory suballocated from 'ring' and
+// bound as a root constant buffer view.
+template <typename CommandList>
+static inline void
+RecordDrawsRootCbv(CommandList* cl, UploadRing& ring, uint32_t threadIndex, const FrameData& frame, uint32_t begin,
+                   uint32_t end)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const UploadAllocation constants = AllocateUpload(ring, threadIndex, 2 * sizeof(float),
+                                                          k_ConstantBufferAlignment);
+        float* p = (float*)constants.cpuAddress;
+        p[0] = frame.positionX[i];
+        p[1] = frame.positionY[i];
+        cl->SetGraphicsRootConstantBufferView(0, constants.gpuAddress);
+        cl->DrawInstanced(1, 1, 0, 0);
+    }
+}
+
+// Constants of draw i are written into 256-byte slot i of this frame's constant buffer region, a CBV
+// descriptor for every slot is created at startup. Every draw changes the descriptor table. Slots of draws that
+// aren't dirty still hold their constants.
+template <typename CommandList, typename DescriptorHandle>
+static inline void
+RecordDrawsDescriptorTable(CommandList* cl, uint8_t* constants, DescriptorHandle descriptors, uint32_t descriptorSize,
+                           const FrameData& frame, uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (IsDrawDirty(frame.dirty, i))
+        {
+            float* p = (float*)(constants + (size_t)i * k_ConstantBufferAlignment);
+            p[0] = frame.positionX[i];
+            p[1] = frame.positionY[i];
+        }
+        DescriptorHandle table = descriptors;
+        table.ptr += (uint64_t)i * descriptorSize;
+        cl->SetGraphicsRootDescriptorTable(0, table);
+        cl->DrawInstanced(1, 1, 0, 0);
+    }
+}
+
+// Positions are written into this frame's part of a position buffer that is bound once per command list as
+// a root SRV (only those of dirty draws), every draw only sets its index (one 32-bit root constant).
+template <typename CommandList>
+static inline void
+RecordDrawsRootSrvIndex(CommandList* cl, float* positions, const FrameData& frame, uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (IsDrawDirty(frame.dirty, i))
+        {
+            positions[i * 2 + 0] = frame.positionX[i];
+            positions[i * 2 + 1] = frame.positionY[i];
+        }
+        cl->SetGraphicsRoot32BitConstant(0, i, 0);
+        cl->DrawInstanced(1, 1, 0, 0);
+    }
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,1117 @@
+#include "Backend.h"
+#include <dxgi1_4.h>
+#include <d3d12.h>
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "d3dx12.h"
+// Generated by Build.bat (fxc /Fh), shader bytecode is embedded in the executable.
+#include "Shaders/VsTransform.h"
+#include "Shaders/VsTransformCbv.h"
+#include "Shaders/VsTransformInstanced.h"
+#include "Shaders/VsTransformTable.h"
+#include "Shaders/VsTransformIndexed.h"
+#include "Shaders/VsTransformMerged.h"
+#include "Shaders/PsShade.h"
+#pragma comment(lib, "d3d12.lib")
+#pragma comment(lib, "dxgi.lib")
+
+#define VHR(hr) if (FAILED(hr)) { assert(0); }
+#define SAFE_RELEASE(obj) if ((obj)) { (obj)->Release(); (obj) = nullptr; }
+
+// Layout of one command in the ExecuteIndirect argument buffer, must match the command signature.
+struct IndirectCommand
+{
+    float position[2];
+    D3D12_DRAW_ARGUMENTS draw;
+};
+
+// Identifies the adapter and driver a pipeline cache was written with, stored at the start of the cache file.
+// The library blob follows it.
+struct PipelineCacheHeader
+{
+    uint32_t magic;
+    uint32_t vendorId;
+    uint32_t deviceId;
+    uint32_t subSysId;
+    uint32_t revision;
+    uint32_t reserved;
+    uint64_t driverVersion;
+};
+#define k_PipelineCacheMagic 0x31435044 // 'DPC1'
+
+struct Dx12Backend : Backend
+{
+    ID3D12Device* device;
+    ID3D12CommandQueue* cmdQueue;
+    // One command list per thread, or per job with -jobsize, and frame in flight.
+    ID3D12CommandAllocator* cmdAlloc[k_MaxNumFramesInFlight][k_MaxNumJobs];
+    ID3D12GraphicsCommandList* cmdList[k_MaxNumFramesInFlight][k_MaxNumJobs];
+    uint8_t cmdListBackBuffer[k_MaxNumFramesInFlight][k_MaxNumJobs];   // back buffer whose RTV the list binds
+    std::atomic<uint64_t> numReusedCmdLists;    // -dynamic: submitted again without recording
+    IDXGISwapChain3* swapChain;
+    ID3D12DescriptorHeap* swapBufferHeap;
+    D3D12_CPU_DESCRIPTOR_HANDLE swapBufferHeapStart;
+    // One swap buffer per frame in flight (at least 2): the back buffer cycles with frameIndex, command lists
+    // of a frame in flight bind the same render target every time they are used.
+    ID3D12Resource* swapBuffers[k_MaxNumFramesInFlight];
+    uint32_t numSwapBuffers;
+    ID3D12Fence* frameFence;
+    HANDLE frameFenceEvent;
+    HWND window;
+    uint32_t descriptorSize;
+    uint32_t descriptorSizeRtv;
+    uint32_t frameIndex;
+    uint32_t backBufferIndex;
+    uint64_t frameCount;
+    ID3D12PipelineState* pso;
+    ID3D12RootSignature* rootSig;
+    // Sort key mode: [0] are pso and rootSig, the others differ only in rasterizer state (no effect on points).
+    ID3D12PipelineState* sortPipelines[k_NumSortRootSignatures * k_NumSortPipelines];
+    ID3D12RootSignature* sortRootSigs[k_NumSortRootSignatures];
+    DrawSort drawSort;
+    const DrawPacket* packets;
+    ID3D12CommandSignature* cmdSignature;
+    ID3D12Resource* argumentBuffer;
+    IndirectCommand* arguments;
+    ID3D12Resource* positionBuffer;
+    float* positions;
+    ID3D12Resource* instanceBuffer;         // -mergedraws: constants of merged draws, one part per frame in flight
+    MergedInstance* instances;
+    DrawMergeThread mergeThreads[k_MaxNumThreads];
+    ID3D12Resource* uploadBuffer;
+    UploadRing uploadRing;
+    ID3D12Resource* constantBuffer;
+    uint8_t* constants;
+    ID3D12DescriptorHeap* cbvHeap;
+    ID3D12QueryHeap* timestampHeap;         // GpuTimestamp_Count timestamps per frame in flight
+    ID3D12Resource* timestampBuffer;        // readback, timestamps are resolved into it at the end of a frame
+    double timestampFrequency;
+    const char* pipelineCacheFile;
+    PipelineCacheHeader pipelineCacheKey;
+    ID3D12PipelineLibrary* pipelineLibrary;
+    std::vector<uint8_t> pipelineLibraryBlob; // must stay alive as long as the library
+    bool pipelineLibraryChanged;
+    std::vector<ID3D12CommandAllocator*> bundleAlloc;
+    std::vector<ID3D12GraphicsCommandList*> bundles;
+    DrawMode mode;
+    uint32_t numThreads;
+    uint32_t numDraws;
+    uint32_t numBundles;
+    uint32_t numFramesInFlight;
+    uint32_t numCmdLists;
+    uint32_t jobSize;
+    JobSystem jobs;
+    uint8_t jobAffinity[k_MaxNumFramesInFlight][k_MaxNumJobs];  // worker that recorded the job's command list
+    bool headless;
+    bool stateFilter;
+    bool noSort;
+    bool mergeDraws;
+    Workers* workers;
+    const FrameData* frame;
+
+    bool IsSupported(DrawMode mode) override;
+    bool Initialize(const Config& config, Workers* workers) override;
+    void Shutdown() override;
+    bool ProcessEvents() override;
+    void SetStatusText(const char* text) override;
+    void Draw(const FrameData& frame, FrameTimings& timings) override;
+    void Present(FrameTimings& timings) override;
+    void Flush() override;
+    uint64_t GetCommandMemorySize() override;
+};
+
+static bool
+InitializeDx12(Dx12Backend& dx)
+{
+    IDXGIFactory4* factory;
+#ifdef _DEBUG
+    VHR(CreateDXGIFactory2(DXGI_CREATE_FACTORY_DEBUG, IID_PPV_ARGS(&factory)));
+#else
+    VHR(CreateDXGIFactory2(0, IID_PPV_ARGS(&factory)));
+#endif
+
+#ifdef _DEBUG
+    {
+        ID3D12Debug* dbg;
+        D3D12GetDebugInterface(IID_PPV_ARGS(&dbg));
+        if (dbg)
+        {
+            dbg->EnableDebugLayer();
+            ID3D12Debug1* dbg1;
+            dbg->QueryInterface(IID_PPV_ARGS(&dbg1));
+            if (dbg1)
+                dbg1->SetEnableGPUBasedValidation(TRUE);
+            SAFE_RELEASE(dbg);
+            SAFE_RELEASE(dbg1);
+        }
+    }
+#endif
+    if (FAILED(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_1, IID_PPV_ARGS(&dx.device))))
+    {
+        // #TODO: Add MessageBox
+        return false;
+    }
+
+    /* pipeline cache key */ {
+        IDXGIAdapter1* adapter;
+        VHR(factory->EnumAdapterByLuid(dx.device->GetAdapterLuid(), IID_PPV_ARGS(&adapter)));
+        DXGI_ADAPTER_DESC1 adapterDesc;
+        VHR(adapter->GetDesc1(&adapterDesc));
+        // User mode driver version, changes with every driver update.
+        LARGE_INTEGER driverVersion = {};
+        adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+        SAFE_RELEASE(adapter);
+
+        dx.pipelineCacheKey.magic = k_PipelineCacheMagic;
+        dx.pipelineCacheKey.vendorId = adapterDesc.VendorId;
+        dx.pipelineCacheKey.deviceId = adapterDesc.DeviceId;
+        dx.pipelineCacheKey.subSysId = adapterDesc.SubSysId;
+        dx.pipelineCacheKey.revision = adapterDesc.Revision;
+        dx.pipelineCacheKey.driverVersion = (uint64_t)driverVersion.QuadPart;
+    }
+
+    D3D12_COMMAND_QUEUE_DESC cmdQueueDesc = {};
+    cmdQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    cmdQueueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+    cmdQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+    VHR(dx.device->CreateCommandQueue(&cmdQueueDesc, IID_PPV_ARGS(&dx.cmdQueue)));
+
+    if (!dx.headless)
+    {
+        DXGI_SWAP_CHAIN_DESC swapChainDesc = {};
+        swapChainDesc.BufferCount = dx.numSwapBuffers;
+        swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+        swapChainDesc.OutputWindow = dx.window;
+        swapChainDesc.SampleDesc.Count = 1;
+        swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+        swapChainDesc.Windowed = TRUE;
+
+        IDXGISwapChain* tempSwapChain;
+        VHR(factory->CreateSwapChain(dx.cmdQueue, &swapChainDesc, &tempSwapChain));
+        VHR(tempSwapChain->QueryInterface(IID_PPV_ARGS(&dx.swapChain)));
+        SAFE_RELEASE(tempSwapChain);
+    }
+    SAFE_RELEASE(factory);
+
+    // One allocator ring per command list, an allocator can be reset only after its frame has completed.
+    for (uint32_t i = 0; i < dx.numFramesInFlight; ++i)
+        for (uint32_t c = 0; c < dx.numCmdLists; ++c)
+            VHR(dx.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&dx.cmdAlloc[i][c])));
+
+    dx.descriptorSize = dx.device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    dx.descriptorSizeRtv = dx.device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+    /* swap buffers */ {
+        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+        heapDesc.NumDescriptors = dx.numSwapBuffers;
+        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+        VHR(dx.device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&dx.swapBufferHeap)));
+        dx.swapBufferHeapStart = dx.swapBufferHeap->GetCPUDescriptorHandleForHeapStart();
+
+        CD3DX12_CPU_DESCRIPTOR_HANDLE handle(dx.swapBufferHeapStart);
+
+        for (uint32_t i = 0; i < dx.numSwapBuffers; ++i)
+        {
+            if (dx.swapChain)
+            {
+                VHR(dx.swapChain->GetBuffer(i, IID_PPV_ARGS(&dx.swapBuffers[i])));
+            }
+            else
+            {
+                // Headless: render into offscreen textures. COMMON and PRESENT states are the same, so Draw()
+                // records identical barriers in both cases.
+                VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+                                                         D3D12_HEAP_FLAG_NONE,
+                                                         &CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM,
+                                                                                       k_DemoResolutionX,
+                                                                                       k_DemoResolutionY, 1, 1, 1, 0,
+                                                                                       D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+                                                         D3D12_RESOURCE_STATE_PRESENT, nullptr,
+                                                         IID_PPV_ARGS(&dx.swapBuffers[i])));
+            }
+
+            dx.device->CreateRenderTargetView(dx.swapBuffers[i], nullptr, handle);
+            handle.Offset(dx.descriptorSizeRtv);
+        }
+    }
+
+    // Command lists of every frame in flight, a list whose draws haven't changed is submitted again (-dynamic).
+    for (uint32_t i = 0; i < dx.numFramesInFlight; ++i)
+    {
+        for (uint32_t c = 0; c < dx.numCmdLists; ++c)
+        {
+            VHR(dx.device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, dx.cmdAlloc[i][c], nullptr, IID_PPV_ARGS(&dx.cmdList[i][c])));
+            VHR(dx.cmdList[i][c]->Close());
+            dx.cmdListBackBuffer[i][c] = UINT8_MAX;
+        }
+    }
+
+    VHR(dx.device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&dx.frameFence)));
+    dx.frameFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+
+    /* timestamps */ {
+        D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+        queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        queryHeapDesc.Count = dx.numFramesInFlight * GpuTimestamp_Count;
+        VHR(dx.device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&dx.timestampHeap)));
+
+        VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+                                               D3D12_HEAP_FLAG_NONE,
+                                               &CD3DX12_RESOURCE_DESC::Buffer(queryHeapDesc.Count * sizeof(uint64_t)),
+                                               D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+                                               IID_PPV_ARGS(&dx.timestampBuffer)));
+        uint64_t frequency;
+        VHR(dx.cmdQueue->GetTimestampFrequency(&frequency));
+        dx.timestampFrequency = (double)frequency;
+    }
+    return true;
+}
+
+// Creates the pipeline library from the cache file. A cache written for another adapter or driver version,
+// or one the runtime rejects, is ignored and replaced by an empty library.
+static void
+LoadPipelineLibrary(Dx12Backend& dx)
+{
+    ID3D12Device1* device1;
+    if (!dx.pipelineCacheFile || FAILED(dx.device->QueryInterface(IID_PPV_ARGS(&device1))))
+        return;
+
+    FILE* file = fopen(dx.pipelineCacheFile, "rb");
+    if (file)
+    {
+        PipelineCacheHeader header = {};
+        if (fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(&header, &dx.pipelineCacheKey, sizeof(header)) == 0)
+        {
+            fseek(file, 0, SEEK_END);
+            const long size = ftell(file) - (long)sizeof(header);
+            fseek(file, sizeof(header), SEEK_SET);
+            dx.pipelineLibraryBlob.resize(size > 0 ? size : 0);
+            if (fread(dx.pipelineLibraryBlob.data(), 1, dx.pipelineLibraryBlob.size(), file) !=
+                dx.pipelineLibraryBlob.size())
+                dx.pipelineLibraryBlob.clear();
+        }
+        fclose(file);
+    }
+
+    if (dx.pipelineLibraryBlob.empty() ||
+        FAILED(device1->CreatePipelineLibrary(dx.pipelineLibraryBlob.data(), dx.pipelineLibraryBlob.size(),
+                                              IID_PPV_ARGS(&dx.pipelineLibrary))))
+    {
+        // D3D12_ERROR_ADAPTER_NOT_FOUND, D3D12_ERROR_DRIVER_VERSION_MISMATCH or a damaged file.
+        dx.pipelineLibraryBlob.clear();
+        VHR(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&dx.pipelineLibrary)));
+    }
+    SAFE_RELEASE(device1);
+}
+
+// Writes the library back to the cache file if pipelines were added to it.
+static void
+SavePipelineLibrary(Dx12Backend& dx)
+{
+    if (!dx.pipelineLibrary || !dx.pipelineLibraryChanged)
+        return;
+
+    std::vector<uint8_t> blob(dx.pipelineLibrary->GetSerializedSize());
+    VHR(dx.pipelineLibrary->Serialize(blob.data(), blob.size()));
+
+    FILE* file = fopen(dx.pipelineCacheFile, "wb");
+    if (!file)
+        return;
+    fwrite(&dx.pipelineCacheKey, sizeof(dx.pipelineCacheKey), 1, file);
+    fwrite(blob.data(), 1, blob.size(), file);
+    fclose(file);
+    dx.pipelineLibraryChanged = false;
+}
+
+// Loads the pipeline from the library or creates it (and stores it in the library). Pipelines are named by a
+// hash of their shaders, so changed shaders get a new entry instead of failing to load.
+static ID3D12PipelineState*
+CreatePipelineState(Dx12Backend& dx, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, bool& o_CacheHit)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const D3D12_SHADER_BYTECODE shaders[2] = { desc.VS, desc.PS };
+    for (const D3D12_SHADER_BYTECODE& shader : shaders)
+        for (size_t i = 0; i < shader.BytecodeLength; ++i)
+            hash = (hash ^ ((const uint8_t*)shader.pShaderBytecode)[i]) * 0x100000001b3ull;
+    for (size_t i = 0; i < sizeof(desc.RasterizerState); ++i)
+        hash = (hash ^ ((const uint8_t*)&desc.RasterizerState)[i]) * 0x100000001b3ull;
+    wchar_t name[32];
+    swprintf(name, 32, L"%016llx", (unsigned long long)hash);
+
+    ID3D12PipelineState* pso = nullptr;
+    o_CacheHit = dx.pipelineLibrary && SUCCEEDED(dx.pipelineLibrary->LoadGraphicsPipeline(name, &desc,
+                                                                                          IID_PPV_ARGS(&pso)));
+    if (o_CacheHit)
+        return pso;
+
+    VHR(dx.device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+    if (dx.pipelineLibrary && SUCCEEDED(dx.pipelineLibrary->StorePipeline(name, pso)))
+        dx.pipelineLibraryChanged = true;
+    return pso;
+}
+
+static void
+Shutdown(Dx12Backend& dx)
+{
+    SAFE_RELEASE(dx.argumentBuffer);
+    SAFE_RELEASE(dx.positionBuffer);
+    SAFE_RELEASE(dx.instanceBuffer);
+    SAFE_RELEASE(dx.uploadBuffer);
+    SAFE_RELEASE(dx.constantBuffer);
+    SAFE_RELEASE(dx.cbvHeap);
+    SAFE_RELEASE(dx.timestampBuffer);
+    SAFE_RELEASE(dx.timestampHeap);
+    for (size_t i = 0; i < dx.bundles.size(); ++i)
+    {
+        SAFE_RELEASE(dx.bundles[i]);
+        SAFE_RELEASE(dx.bundleAlloc[i]);
+    }
+    SAFE_RELEASE(dx.cmdSignature);
+    for (uint32_t i = 1; i < k_NumSortRootSignatures * k_NumSortPipelines; ++i)
+        SAFE_RELEASE(dx.sortPipelines[i]);
+    for (uint32_t i = 1; i < k_NumSortRootSignatures; ++i)
+        SAFE_RELEASE(dx.sortRootSigs[i]);
+    SAFE_RELEASE(dx.pso);
+    SAFE_RELEASE(dx.pipelineLibrary);
+    SAFE_RELEASE(dx.rootSig);
+    for (uint32_t c = 0; c < dx.numCmdLists; ++c)
+    {
+        for (uint32_t i = 0; i < dx.numFramesInFlight; ++i)
+        {
+            SAFE_RELEASE(dx.cmdList[i][c]);
+            SAFE_RELEASE(dx.cmdAlloc[i][c]);
+        }
+    }
+    SAFE_RELEASE(dx.swapBufferHeap);
+    for (uint32_t i = 0; i < dx.numSwapBuffers; ++i)
+        SAFE_RELEASE(dx.swapBuffers[i]);
+    CloseHandle(dx.frameFenceEvent);
+    SAFE_RELEASE(dx.frameFence);
+    SAFE_RELEASE(dx.swapChain);
+    SAFE_RELEASE(dx.cmdQueue);
+    SAFE_RELEASE(dx.device);
+}
+
+static void
+Present(Dx12Backend& dx, FrameTimings& timings)
+{
+    if (dx.swapChain)
+    {
+        TRACE_ZONE("Present");
+        dx.swapChain->Present(0, 0);
+    }
+    dx.cmdQueue->Signal(dx.frameFence, ++dx.frameCount);
+
+    const uint64_t deviceFrameCount = dx.frameFence->GetCompletedValue();
+
+    if ((dx.frameCount - deviceFrameCount) >= dx.numFramesInFlight)
+    {
+        const double waitBegin = GetTime();
+        TRACE_ZONE("Wait");
+        dx.frameFence->SetEventOnCompletion(dx.frameCount - dx.numFramesInFlight + 1, dx.frameFenceEvent);
+        WaitForSingleObject(dx.frameFenceEvent, INFINITE);
+        timings.wait = GetTime() - waitBegin;
+    }
+
+    dx.frameIndex = (dx.frameIndex + 1) % dx.numFramesInFlight;
+
+    // The oldest frame in flight, which now gets recorded into again, is known to be complete: its
+    // timestamps can be read without stalling.
+    if (dx.frameCount >= dx.numFramesInFlight)
+    {
+        const uint32_t first = dx.frameIndex * GpuTimestamp_Count;
+        const CD3DX12_RANGE readRange(first * sizeof(uint64_t), (first + GpuTimestamp_Count) * sizeof(uint64_t));
+        uint8_t* data;
+        VHR(dx.timestampBuffer->Map(0, &readRange, (void**)&data));
+        SetGpuTimings(timings, (const uint64_t*)(data + readRange.Begin), dx.timestampFrequency);
+        dx.timestampBuffer->Unmap(0, &CD3DX12_RANGE(0, 0));
+    }
+
+    if (dx.swapChain)
+        dx.backBufferIndex = dx.swapChain->GetCurrentBackBufferIndex();
+    else
+        dx.backBufferIndex = dx.frameIndex;
+}
+
+static void
+Flush(Dx12Backend& dx)
+{
+    dx.cmdQueue->Signal(dx.frameFence, ++dx.frameCount);
+    dx.frameFence->SetEventOnCompletion(dx.frameCount, dx.frameFenceEvent);
+    WaitForSingleObject(dx.frameFenceEvent, INFINITE);
+}
+
+static LRESULT CALLBACK
+ProcessWindowMessage(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
+{
+    switch (message)
+    {
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        return 0;
+    case WM_KEYDOWN:
+        if (wparam == VK_ESCAPE)
+        {
+            PostQuitMessage(0);
+            return 0;
+        }
+        break;
+    }
+    return DefWindowProc(window, message, wparam, lparam);
+}
+
+static void
+InitializeWindow(Dx12Backend& dx)
+{
+    WNDCLASS winclass = {};
+    winclass.lpfnWndProc = ProcessWindowMessage;
+    winclass.hInstance = GetModuleHandle(nullptr);
+    winclass.hCursor = LoadCursor(nullptr, IDC_ARROW);
+    winclass.lpszClassName = k_DemoName;
+    if (!RegisterClass(&winclass))
+        assert(0);
+
+    RECT rect = { 0, 0, k_DemoResolutionX, k_DemoResolutionY };
+    if (!AdjustWindowRect(&rect, WS_OVERLAPPED | WS_SYSMENU | WS_CAPTION | WS_MINIMIZEBOX, 0))
+        assert(0);
+
+    dx.window = CreateWindowEx(
+        0, k_DemoName, k_DemoName, WS_OVERLAPPED | WS_SYSMENU | WS_CAPTION | WS_MINIMIZEBOX | WS_VISIBLE,
+        CW_USEDEFAULT, CW_USEDEFAULT,
+        rect.right - rect.left, rect.bottom - rect.top,
+        nullptr, nullptr, nullptr, 0);
+    assert(dx.window);
+}
+
+// Resets command list 'cmdListIndex' and sets render target and pipeline state. The first command list of a
+// frame also transitions and clears the back buffer.
+static ID3D12GraphicsCommandList*
+BeginCommandList(Dx12Backend& dx, uint32_t cmdListIndex)
+{
+    ID3D12CommandAllocator* cmdAlloc = dx.cmdAlloc[dx.frameIndex][cmdListIndex];
+    ID3D12GraphicsCommandList* cl = dx.cmdList[dx.frameIndex][cmdListIndex];
+    const bool isFirst = cmdListIndex == 0;
+
+    /* reset */ {
+        TRACE_ZONE("Reset");
+        cmdAlloc->Reset();
+        cl->Reset(cmdAlloc, nullptr);
+    }
+
+    cl->RSSetViewports(1, &CD3DX12_VIEWPORT(0.0f, 0.0f, (float)k_DemoResolutionX, (float)k_DemoResolutionY));
+    cl->RSSetScissorRects(1, &CD3DX12_RECT(0, 0, k_DemoResolutionX, k_DemoResolutionY));
+
+    const uint32_t firstTimestamp = dx.frameIndex * GpuTimestamp_Count;
+    if (isFirst)
+    {
+        cl->EndQuery(dx.timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstTimestamp + GpuTimestamp_FrameBegin);
+        cl->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(dx.swapBuffers[dx.backBufferIndex],
+                                                                     D3D12_RESOURCE_STATE_PRESENT,
+                                                                     D3D12_RESOURCE_STATE_RENDER_TARGET));
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE backBufferDescriptor = CD3DX12_CPU_DESCRIPTOR_HANDLE(dx.swapBufferHeapStart,
+                                                                                     dx.backBufferIndex,
+                                                                                     dx.descriptorSizeRtv);
+    cl->OMSetRenderTargets(1, &backBufferDescriptor, 0, nullptr);
+    dx.cmdListBackBuffer[dx.frameIndex][cmdListIndex] = (uint8_t)dx.backBufferIndex;
+
+    if (isFirst)
+    {
+        const float clearColor[4] = { 0.0f, 0.2f, 0.4f, 1.0f };
+        cl->ClearRenderTargetView(backBufferDescriptor, clearColor, 0, nullptr);
+        cl->EndQuery(dx.timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstTimestamp + GpuTimestamp_ClearEnd);
+    }
+
+    // Pipeline state is not inherited between command lists, every thread has to set it.
+    cl->SetPipelineState(dx.pso);
+    cl->SetGraphicsRootSignature(dx.rootSig);
+    cl->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+    if (dx.cbvHeap)
+        cl->SetDescriptorHeaps(1, &dx.cbvHeap);
+
+    return cl;
+}
+
+// The last command list of a frame transitions the back buffer back to present state and resolves the
+// timestamps of the frame.
+static void
+EndCommandList(Dx12Backend& dx, ID3D12GraphicsCommandList* cl, bool isLast)
+{
+    if (isLast)
+    {
+        const uint32_t firstTimestamp = dx.frameIndex * GpuTimestamp_Count;
+        cl->EndQuery(dx.timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstTimestamp + GpuTimestamp_DrawsEnd);
+        cl->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(dx.swapBuffers[dx.backBufferIndex],
+                                                                     D3D12_RESOURCE_STATE_RENDER_TARGET,
+                                                                     D3D12_RESOURCE_STATE_PRESENT));
+        cl->EndQuery(dx.timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstTimestamp + GpuTimestamp_FrameEnd);
+        cl->ResolveQueryData(dx.timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstTimestamp, GpuTimestamp_Count,
+                             dx.timestampBuffer, firstTimestamp * sizeof(uint64_t));
+    }
+    TRACE_ZONE("Close");
+    VHR(cl->Close());
+}
+
+// Records draws [begin, end) into command list 'cmdListIndex' on thread 'threadIndex'.
+static void
+RecordCommandList(Dx12Backend& dx, uint32_t cmdListIndex, uint32_t threadIndex, uint32_t begin, uint32_t end)
+{
+    // The allocator isn't reset either, the GPU is done with this frame in flight's lists but they stay valid.
+    // Lists bind the render target they were recorded for. Back buffers cycle with frames in flight, except
+    // with one frame in flight (two swap buffers): a list is only submitted again when it binds this frame's
+    // back buffer.
+    if (dx.cmdListBackBuffer[dx.frameIndex][cmdListIndex] == dx.backBufferIndex &&
+        CanReuseCommandList(dx.mode, *dx.frame, cmdListIndex, dx.numCmdLists, begin, end))
+    {
+        dx.numReusedCmdLists.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TRACE_ZONE("Record");
+
+    ID3D12GraphicsCommandList* cl = BeginCommandList(dx, cmdListIndex);
+    MergedInstance* instances = nullptr;
+    uint64_t instanceBufferAddress = 0;
+    if (dx.mergeDraws)
+    {
+        instances = dx.instances + (size_t)dx.frameIndex * dx.numDraws;
+        instanceBufferAddress = dx.instanceBuffer->GetGPUVirtualAddress() +
+                                (uint64_t)dx.frameIndex * dx.numDraws * sizeof(MergedInstance);
+    }
+    RecordProfiled(cl, threadIndex, [&](auto* recordCl) {
+        if (dx.mode == DrawMode_RootCbv)
+        {
+            RecordDrawsRootCbv(recordCl, dx.uploadRing, threadIndex, *dx.frame, begin, end);
+        }
+        else if (dx.mode == DrawMode_DescriptorTable)
+        {
+            const uint32_t firstSlot = dx.frameIndex * dx.numDraws;
+            D3D12_GPU_DESCRIPTOR_HANDLE descriptors = dx.cbvHeap->GetGPUDescriptorHandleForHeapStart();
+            descriptors.ptr += (uint64_t)firstSlot * dx.descriptorSize;
+            RecordDrawsDescriptorTable(recordCl, dx.constants + (size_t)firstSlot * k_ConstantBufferAlignment,
+                                       descriptors, dx.descriptorSize, *dx.frame, begin, end);
+        }
+        else if (dx.mode == DrawMode_SortKey)
+        {
+            uint64_t& numStateChanges = dx.drawSort.threads[threadIndex].numStateChanges;
+            if (dx.mergeDraws)
+            {
+                RecordMerged(recordCl, dx.mergeThreads[threadIndex], dx.pso, dx.rootSig,
+                             D3D_PRIMITIVE_TOPOLOGY_POINTLIST, instances, instanceBufferAddress, begin,
+                             [&](auto* mergeCl) {
+                                 numStateChanges += RecordDrawPackets(mergeCl, dx.sortPipelines, dx.sortRootSigs,
+                                                                      dx.packets, begin, end);
+                             });
+            }
+            else
+            {
+                numStateChanges += RecordDrawPackets(recordCl, dx.sortPipelines, dx.sortRootSigs, dx.packets, begin,
+                                                     end);
+            }
+        }
+        else if (dx.mode == DrawMode_RootSrvIndex)
+        {
+            recordCl->SetGraphicsRootShaderResourceView(1, dx.positionBuffer->GetGPUVirtualAddress() +
+                                                           dx.frameIndex * dx.numDraws * 2 * sizeof(float));
+            float* positions = dx.positions + dx.frameIndex * dx.numDraws * 2;
+            RecordDrawsRootSrvIndex(recordCl, positions, *dx.frame, begin, end);
+        }
+        else if (dx.mergeDraws)
+        {
+            RecordMerged(recordCl, dx.mergeThreads[threadIndex], dx.pso, dx.rootSig, D3D_PRIMITIVE_TOPOLOGY_POINTLIST,
+                         instances, instanceBufferAddress, begin, [&](auto* mergeCl) {
+                             RecordDrawsFiltered(mergeCl, false, dx.pso, dx.rootSig, D3D_PRIMITIVE_TOPOLOGY_POINTLIST,
+                                                 *dx.frame, begin, end);
+                         });
+        }
+        else
+        {
+            RecordDrawsFiltered(recordCl, dx.stateFilter, dx.pso, dx.rootSig, D3D_PRIMITIVE_TOPOLOGY_POINTLIST,
+                                *dx.frame, begin, end);
+        }
+    });
+    EndCommandList(dx, cl, cmdListIndex == dx.numCmdLists - 1);
+}
+
+static void
+RecordDrawRange(void* context, uint32_t threadIndex)
+{
+    Dx12Backend& dx = *(Dx12Backend*)context;
+    uint32_t begin, end;
+    GetDrawRange(dx.numDraws, dx.numThreads, threadIndex, begin, end);
+    RecordCommandList(dx, threadIndex, threadIndex, begin, end);
+}
+
+static void
+RecordDrawJob(void* context, uint32_t jobIndex, uint32_t threadIndex)
+{
+    Dx12Backend& dx = *(Dx12Backend*)context;
+    const uint32_t begin = jobIndex * dx.jobSize;
+    RecordCommandList(dx, jobIndex, threadIndex, begin, std::min(begin + dx.jobSize, dx.numDraws));
+}
+
+// Records all draws, one command list per thread or, with -jobsize, per job on the work-stealing scheduler.
+static void
+RecordDraws(Dx12Backend& dx, FrameTimings& timings)
+{
+    if (dx.jobSize)
+    {
+        // Jobs stay on the worker that recorded them into this frame in flight's allocators last time.
+        RunJobs(dx.jobs, RecordDrawJob, &dx, dx.numCmdLists, dx.jobAffinity[dx.frameIndex]);
+        GetJobStats(dx.jobs, timings);
+    }
+    else
+    {
+        RunWorkers(*dx.workers, RecordDrawRange, &dx);
+    }
+}
+
+// Writes root constants and draw arguments of one thread's draw range into this frame's part of the
+// argument buffer, only those of dirty draws.
+static void
+WriteIndirectRange(void* context, uint32_t threadIndex)
+{
+    Dx12Backend& dx = *(Dx12Backend*)context;
+    IndirectCommand* arguments = dx.arguments + dx.frameIndex * dx.numDraws;
+    const FrameData& frame = *dx.frame;
+
+    uint32_t begin, end;
+    GetDrawRange(dx.numDraws, dx.numThreads, threadIndex, begin, end);
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (!IsDrawDirty(frame.dirty, i))
+            continue;
+        IndirectCommand command;
+        command.position[0] = frame.positionX[i];
+        command.position[1] = frame.positionY[i];
+        command.draw = { 1, 1, 0, 0 };
+        arguments[i] = command; // upload heap is write-combined, write whole commands
+    }
+}
+
+// Writes positions of one thread's draw range into this frame's part of the position buffer, only those of
+// dirty draws.
+static void
+WritePositionRange(void* context, uint32_t threadIndex)
+{
+    Dx12Backend& dx = *(Dx12Backend*)context;
+    float* positions = dx.positions + dx.frameIndex * dx.numDraws * 2;
+    const FrameData& frame = *dx.frame;
+
+    uint32_t begin, end;
+    GetDrawRange(dx.numDraws, dx.numThreads, threadIndex, begin, end);
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (IsDrawDirty(frame.dirty, i))
+        {
+            positions[i * 2 + 0] = frame.positionX[i];
+            positions[i * 2 + 1] = frame.positionY[i];
+        }
+    }
+}
+
+// Records bundles threadIndex, threadIndex + numThreads, ... Every bundle has its own allocator. Only the
+// draw index is recorded, so bundles stay valid for all frames.
+static void
+RecordBundleRange(void* context, uint32_t threadIndex)
+{
+    Dx12Backend& dx = *(Dx12Backend*)context;
+    const uint32_t numBundles = (uint32_t)dx.bundles.size();
+
+    for (uint32_t b = threadIndex; b < numBundles; b += dx.numThreads)
+    {
+        uint32_t begin, end;
+        GetDrawRange(dx.numDraws, numBundles, b, begin, end);
+
+        ID3D12GraphicsCommandList* bundle = dx.bundles[b];
+        // Same root signature as the calling command list, root arguments (the position buffer) are inherited.
+        bundle->SetGraphicsRootSignature(dx.rootSig);
+        bundle->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            bundle->SetGraphicsRoot32BitConstant(0, i, 0);
+            bundle->DrawInstanced(1, 1, 0, 0);
+        }
+        VHR(bundle->Close());
+    }
+}
+
+static void
+Draw(Dx12Backend& dx, const FrameData& frame, FrameTimings& timings)
+{
+    const double t0 = GetTime();
+    dx.frame = &frame;
+    uint32_t numCmdLists = dx.numCmdLists;
+
+    if (dx.mode == DrawMode_ExecuteIndirect)
+    {
+        RunWorkers(*dx.workers, WriteIndirectRange, &dx);
+
+        ID3D12GraphicsCommandList* cl = BeginCommandList(dx, 0);
+        cl->ExecuteIndirect(dx.cmdSignature, dx.numDraws, dx.argumentBuffer,
+                            dx.frameIndex * dx.numDraws * sizeof(IndirectCommand), nullptr, 0);
+        EndCommandList(dx, cl, true);
+        numCmdLists = 1;
+    }
+    else if (dx.mode == DrawMode_Instanced)
+    {
+        RunWorkers(*dx.workers, WritePositionRange, &dx);
+
+        ID3D12GraphicsCommandList* cl = BeginCommandList(dx, 0);
+        cl->SetGraphicsRootShaderResourceView(0, dx.positionBuffer->GetGPUVirtualAddress() +
+                                                 dx.frameIndex * dx.numDraws * 2 * sizeof(float));
+        cl->DrawInstanced(1, dx.numDraws, 0, 0);
+        EndCommandList(dx, cl, true);
+        numCmdLists = 1;
+    }
+    else if (dx.mode == DrawMode_Bundle)
+    {
+        RunWorkers(*dx.workers, WritePositionRange, &dx);
+
+        ID3D12GraphicsCommandList* cl = BeginCommandList(dx, 0);
+        cl->SetGraphicsRootShaderResourceView(1, dx.positionBuffer->GetGPUVirtualAddress() +
+                                                 dx.frameIndex * dx.numDraws * 2 * sizeof(float));
+        for (ID3D12GraphicsCommandList* bundle : dx.bundles)
+            cl->ExecuteBundle(bundle);
+        EndCommandList(dx, cl, true);
+        numCmdLists = 1;
+    }
+    else if (dx.mode == DrawMode_SortKey)
+    {
+        dx.packets = BuildDrawPackets(dx.drawSort, *dx.workers, frame);
+        RecordDraws(dx, timings);
+    }
+    else if (dx.mode == DrawMode_RootCbv)
+    {
+        // Memory of frames the GPU has finished is reused, this frame's is released when the fence reaches
+        // the value Present() signals for it.
+        BeginUploadFrame(dx.uploadRing, dx.frameFence->GetCompletedValue());
+        RecordDraws(dx, timings);
+        EndUploadFrame(dx.uploadRing, dx.frameCount + 1);
+    }
+    else
+    {
+        RecordDraws(dx, timings);
+    }
+    const double t1 = GetTime();
+
+    // All chunks go to the GPU in one submission, in draw order.
+    /* submit */ {
+        TRACE_ZONE("ExecuteCommandLists");
+        dx.cmdQueue->ExecuteCommandLists(numCmdLists, (ID3D12CommandList**)dx.cmdList[dx.frameIndex]);
+    }
+    const double t2 = GetTime();
+
+    timings.record = t1 - t0;
+    timings.submit = t2 - t1;
+}
+
+static bool
+Initialize(Dx12Backend& dx)
+{
+    /* pso */ {
+        const double t0 = GetTime();
+        LoadPipelineLibrary(dx);
+
+        // Instanced mode reads positions from a structured buffer indexed by SV_InstanceID, bundle and root SRV
+        // modes from the same buffer indexed by a root constant. Merged draws read the root constants of every
+        // draw from the instance buffer.
+        D3D12_SHADER_BYTECODE vsCode = { g_VsTransform, sizeof(g_VsTransform) };
+        if (dx.mergeDraws)
+            vsCode = { g_VsTransformMerged, sizeof(g_VsTransformMerged) };
+        else if (dx.mode == DrawMode_Instanced)
+            vsCode = { g_VsTransformInstanced, sizeof(g_VsTransformInstanced) };
+        else if (dx.mode == DrawMode_Bundle || dx.mode == DrawMode_RootSrvIndex)
+            vsCode = { g_VsTransformIndexed, sizeof(g_VsTransformIndexed) };
+        else if (dx.mode == DrawMode_RootCbv)
+            vsCode = { g_VsTransformCbv, sizeof(g_VsTransformCbv) };
+        else if (dx.mode == DrawMode_DescriptorTable)
+            vsCode = { g_VsTransformTable, sizeof(g_VsTransformTable) };
+
+        // Root signature comes from the vertex shader, it overrides the one embedded in the pixel shader.
+        VHR(dx.device->CreateRootSignature(0, vsCode.pShaderBytecode, vsCode.BytecodeLength,
+                                           IID_PPV_ARGS(&dx.rootSig)));
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+        psoDesc.pRootSignature = dx.rootSig;
+        psoDesc.VS = vsCode;
+        psoDesc.PS = { g_PsShade, sizeof(g_PsShade) };
+        psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+        psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+        psoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+        psoDesc.SampleMask = 0xffffffff;
+        psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+        psoDesc.NumRenderTargets = 1;
+        psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+        psoDesc.SampleDesc.Count = 1;
+
+        bool cacheHit;
+        dx.pso = CreatePipelineState(dx, psoDesc, cacheHit);
+
+        if (dx.mode == DrawMode_SortKey)
+        {
+            // Root signatures are created from the same blob, every pipeline with the root signature of its
+            // sort key.
+            dx.sortRootSigs[0] = dx.rootSig;
+            for (uint32_t i = 1; i < k_NumSortRootSignatures; ++i)
+                VHR(dx.device->CreateRootSignature(0, vsCode.pShaderBytecode, vsCode.BytecodeLength,
+                                                   IID_PPV_ARGS(&dx.sortRootSigs[i])));
+            dx.sortPipelines[0] = dx.pso;
+            for (uint32_t i = 1; i < k_NumSortRootSignatures * k_NumSortPipelines; ++i)
+            {
+                psoDesc.pRootSignature = dx.sortRootSigs[i / k_NumSortPipelines];
+                psoDesc.RasterizerState.CullMode = (i & 1) ? D3D12_CULL_MODE_BACK : D3D12_CULL_MODE_NONE;
+                psoDesc.RasterizerState.FrontCounterClockwise = (i & 2) ? TRUE : FALSE;
+                psoDesc.RasterizerState.DepthBias = (INT)(i / k_NumSortPipelines);
+                bool sortCacheHit;
+                dx.sortPipelines[i] = CreatePipelineState(dx, psoDesc, sortCacheHit);
+                cacheHit &= sortCacheHit;
+            }
+        }
+        SavePipelineLibrary(dx);
+        printf("pipeline_cache: file=%s hit=%u pso_ms=%.3f\n", dx.pipelineCacheFile ? dx.pipelineCacheFile : "none",
+               cacheHit ? 1 : 0, (GetTime() - t0) * 1000.0);
+    }
+
+    if (dx.mode == DrawMode_ExecuteIndirect)
+    {
+        // Every command changes the root constants (position) and then draws.
+        D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[2] = {};
+        argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+        argumentDescs[0].Constant.RootParameterIndex = 0;
+        argumentDescs[0].Constant.DestOffsetIn32BitValues = 0;
+        argumentDescs[0].Constant.Num32BitValuesToSet = 2;
+        argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+        D3D12_COMMAND_SIGNATURE_DESC cmdSignatureDesc = {};
+        cmdSignatureDesc.ByteStride = sizeof(IndirectCommand);
+        cmdSignatureDesc.NumArgumentDescs = 2;
+        cmdSignatureDesc.pArgumentDescs = argumentDescs;
+        VHR(dx.device->CreateCommandSignature(&cmdSignatureDesc, dx.rootSig, IID_PPV_ARGS(&dx.cmdSignature)));
+
+        // Persistently mapped upload buffer, one part per frame in flight.
+        VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                                               D3D12_HEAP_FLAG_NONE,
+                                               &CD3DX12_RESOURCE_DESC::Buffer(dx.numFramesInFlight * dx.numDraws * sizeof(IndirectCommand)),
+                                               D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                               IID_PPV_ARGS(&dx.argumentBuffer)));
+        VHR(dx.argumentBuffer->Map(0, &CD3DX12_RANGE(0, 0), (void**)&dx.arguments));
+    }
+
+    if (dx.mode == DrawMode_Instanced || dx.mode == DrawMode_Bundle || dx.mode == DrawMode_RootSrvIndex)
+    {
+        VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                                               D3D12_HEAP_FLAG_NONE,
+                                               &CD3DX12_RESOURCE_DESC::Buffer(dx.numFramesInFlight * dx.numDraws * 2 * sizeof(float)),
+                                               D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                               IID_PPV_ARGS(&dx.positionBuffer)));
+        VHR(dx.positionBuffer->Map(0, &CD3DX12_RANGE(0, 0), (void**)&dx.positions));
+    }
+
+    if (dx.mergeDraws)
+    {
+        VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                                               D3D12_HEAP_FLAG_NONE,
+                                               &CD3DX12_RESOURCE_DESC::Buffer(dx.numFramesInFlight * dx.numDraws * sizeof(MergedInstance)),
+                                               D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                               IID_PPV_ARGS(&dx.instanceBuffer)));
+        VHR(dx.instanceBuffer->Map(0, &CD3DX12_RANGE(0, 0), (void**)&dx.instances));
+    }
+
+    if (dx.mode == DrawMode_RootCbv)
+    {
+        // Persistently mapped, shared by all recording threads.
+        const uint64_t size = GetUploadRingSize((uint64_t)dx.numDraws * k_ConstantBufferAlignment, dx.numThreads,
+                                                dx.numFramesInFlight);
+        VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                                               D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(size),
+                                               D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                               IID_PPV_ARGS(&dx.uploadBuffer)));
+        void* cpuBase;
+        VHR(dx.uploadBuffer->Map(0, &CD3DX12_RANGE(0, 0), &cpuBase));
+        InitializeUploadRing(dx.uploadRing, cpuBase, dx.uploadBuffer->GetGPUVirtualAddress(), size);
+    }
+
+    if (dx.mode == DrawMode_SortKey)
+        InitializeDrawSort(dx.drawSort, dx.numDraws, dx.numThreads, !dx.noSort);
+
+    if (dx.mode == DrawMode_DescriptorTable)
+    {
+        // One constant buffer slot and one CBV per draw and frame in flight, created once.
+        const uint32_t numDescriptors = dx.numFramesInFlight * dx.numDraws;
+        if (numDescriptors > D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1)
+        {
+            fprintf(stderr, "Descriptor table mode supports at most %u draws x frames in flight\n",
+                    D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1);
+            return false;
+        }
+
+        VHR(dx.device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                                               D3D12_HEAP_FLAG_NONE,
+                                               &CD3DX12_RESOURCE_DESC::Buffer((uint64_t)numDescriptors * k_ConstantBufferAlignment),
+                                               D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                                               IID_PPV_ARGS(&dx.constantBuffer)));
+        VHR(dx.constantBuffer->Map(0, &CD3DX12_RANGE(0, 0), (void**)&dx.constants));
+
+        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+        heapDesc.NumDescriptors = numDescriptors;
+        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+        VHR(dx.device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&dx.cbvHeap)));
+
+        CD3DX12_CPU_DESCRIPTOR_HANDLE handle(dx.cbvHeap->GetCPUDescriptorHandleForHeapStart());
+        for (uint32_t i = 0; i < numDescriptors; ++i)
+        {
+            D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+            cbvDesc.BufferLocation = dx.constantBuffer->GetGPUVirtualAddress() + (uint64_t)i * k_ConstantBufferAlignment;
+            cbvDesc.SizeInBytes = k_ConstantBufferAlignment;
+            dx.device->CreateConstantBufferView(&cbvDesc, handle);
+            handle.Offset(dx.descriptorSize);
+        }
+    }
+
+    if (dx.mode == DrawMode_Bundle)
+    {
+        dx.bundleAlloc.resize(dx.numBundles);
+        dx.bundles.resize(dx.numBundles);
+        for (uint32_t i = 0; i < dx.numBundles; ++i)
+        {
+            VHR(dx.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_BUNDLE, IID_PPV_ARGS(&dx.bundleAlloc[i])));
+            VHR(dx.device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_BUNDLE, dx.bundleAlloc[i], dx.pso,
+                                             IID_PPV_ARGS(&dx.bundles[i])));
+        }
+        RunWorkers(*dx.workers, RecordBundleRange, &dx);
+    }
+    return true;
+}
+
+bool
+Dx12Backend::IsSupported(DrawMode drawMode)
+{
+    return drawMode == DrawMode_Loop || drawMode == DrawMode_ExecuteIndirect || drawMode == DrawMode_Instanced ||
+           drawMode == DrawMode_Bundle || drawMode == DrawMode_RootCbv || drawMode == DrawMode_DescriptorTable ||
+           drawMode == DrawMode_RootSrvIndex || drawMode == DrawMode_SortKey;
+}
+
+bool
+Dx12Backend::Initialize(const Config& config, Workers* sharedWorkers)
+{
+    workers = sharedWorkers;
+    mode = config.mode;
+    numThreads = config.numThreads;
+    numDraws = config.numDraws;
+    numBundles = std::min(config.numBundles, config.numDraws);
+    pipelineCacheFile = config.pipelineCache;
+    numFramesInFlight = config.numFramesInFlight;
+    numSwapBuffers = std::max(2u, numFramesInFlight);
+    headless = config.headless;
+    stateFilter = config.stateFilter;
+    noSort = config.noSort;
+    mergeDraws = config.mergeDraws && (mode == DrawMode_Loop || mode == DrawMode_SortKey);
+    numReusedCmdLists = 0;
+    // Modes that record one command list on the main thread don't use jobs.
+    const bool recordsDraws = mode != DrawMode_ExecuteIndirect && mode != DrawMode_Instanced && mode != DrawMode_Bundle;
+    jobSize = recordsDraws ? GetRecordJobSize(config.jobSize, numDraws) : 0;
+    numCmdLists = jobSize ? (numDraws + jobSize - 1) / jobSize : numThreads;
+    if (jobSize)
+    {
+        InitializeJobSystem(jobs, workers, numThreads);
+        for (uint32_t i = 0; i < k_MaxNumFramesInFlight; ++i)
+            InitializeJobAffinity(jobAffinity[i], numCmdLists, numThreads);
+    }
+
+    if (!headless)
+        InitializeWindow(*this);
+    if (!InitializeDx12(*this))
+        return false;
+    return ::Initialize(*this);
+}
+
+void
+Dx12Backend::Shutdown()
+{
+    if (mode == DrawMode_SortKey)
+        PrintDrawSortStats(drawSort);
+    if (mergeDraws)
+        PrintDrawMergeStats(mergeThreads, numThreads, frameCount);
+    if (jobSize)
+        PrintJobStats(jobs);
+    if (numReusedCmdLists)
+        printf("cmdlists: reused_per_frame=%.1f of %u\n", (double)numReusedCmdLists / std::max(1ull,
+               (unsigned long long)frameCount), numCmdLists);
+    ::Shutdown(*this);
+}
+
+bool
+Dx12Backend::ProcessEvents()
+{
+    if (!window)
+        return true;
+
+    MSG msg = {};
+    while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+    {
+        DispatchMessage(&msg);
+        if (msg.message == WM_QUIT)
+            return false;
+    }
+    return true;
+}
+
+void
+Dx12Backend::SetStatusText(const char* text)
+{
+    if (window)
+        SetWindowText(window, text);
+    else
+        Backend::SetStatusText(text);
+}
+
+void
+Dx12Backend::Draw(const FrameData& frameData, FrameTimings& timings)
+{
+    ::Draw(*this, frameData, timings);
+}
+
+void
+Dx12Backend::Present(FrameTimings& timings)
+{
+    ::Present(*this, timings);
+}
+
+void
+Dx12Backend::Flush()
+{
+    ::Flush(*this);
+}
+
+// Command allocators don't expose their size, only the upload buffers are counted.
+uint64_t
+Dx12Backend::GetCommandMemorySize()
+{
+    uint64_t size = 0;
+    if (argumentBuffer)
+        size += argumentBuffer->GetDesc().Width;
+    if (positionBuffer)
+        size += positionBuffer->GetDesc().Width;
+    if (instanceBuffer)
+        size += instanceBuffer->GetDesc().Width;
+    if (uploadBuffer)
+        size += uploadBuffer->GetDesc().Width;
+    if (constantBuffer)
+        size += constantBuffer->GetDesc().Width;
+    return size;
+}
+
+Backend*
+CreateDx12Backend()
+{
+    return new Dx12Backend();
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,458 @@
+#include "Backend.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glcorearb.h>
+
+// Headless OpenGL backend (EGL surfaceless, runs on Mesa llvmpipe). Renders the same points three ways:
+// DrawMode_Loop                   - glUniform2fv + glDrawArrays per point
+// DrawMode_MultiDrawIndirect      - glMultiDrawArraysIndirect, draw commands and positions written to
+//                                   persistent mapped buffers
+// DrawMode_MultiDrawIndirectCount - same as above, draw count read from GL_PARAMETER_BUFFER
+
+#define GL_FUNCTIONS(X) \
+    X(PFNGLGETSTRINGPROC, glGetString) \
+    X(PFNGLGETERRORPROC, glGetError) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram) \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+    X(PFNGLUNIFORM2FVPROC, glUniform2fv) \
+    X(PFNGLCREATEFRAMEBUFFERSPROC, glCreateFramebuffers) \
+    X(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers) \
+    X(PFNGLCREATERENDERBUFFERSPROC, glCreateRenderbuffers) \
+    X(PFNGLDELETERENDERBUFFERSPROC, glDeleteRenderbuffers) \
+    X(PFNGLNAMEDRENDERBUFFERSTORAGEPROC, glNamedRenderbufferStorage) \
+    X(PFNGLNAMEDFRAMEBUFFERRENDERBUFFERPROC, glNamedFramebufferRenderbuffer) \
+    X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer) \
+    X(PFNGLCREATEVERTEXARRAYSPROC, glCreateVertexArrays) \
+    X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays) \
+    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
+    X(PFNGLENABLEVERTEXARRAYATTRIBPROC, glEnableVertexArrayAttrib) \
+    X(PFNGLVERTEXARRAYATTRIBFORMATPROC, glVertexArrayAttribFormat) \
+    X(PFNGLVERTEXARRAYATTRIBBINDINGPROC, glVertexArrayAttribBinding) \
+    X(PFNGLVERTEXARRAYBINDINGDIVISORPROC, glVertexArrayBindingDivisor) \
+    X(PFNGLVERTEXARRAYVERTEXBUFFERPROC, glVertexArrayVertexBuffer) \
+    X(PFNGLCREATEBUFFERSPROC, glCreateBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+    X(PFNGLNAMEDBUFFERSTORAGEPROC, glNamedBufferStorage) \
+    X(PFNGLMAPNAMEDBUFFERRANGEPROC, glMapNamedBufferRange) \
+    X(PFNGLUNMAPNAMEDBUFFERPROC, glUnmapNamedBuffer) \
+    X(PFNGLVIEWPORTPROC, glViewport) \
+    X(PFNGLCLEARCOLORPROC, glClearColor) \
+    X(PFNGLCLEARPROC, glClear) \
+    X(PFNGLDRAWARRAYSPROC, glDrawArrays) \
+    X(PFNGLMULTIDRAWARRAYSINDIRECTPROC, glMultiDrawArraysIndirect) \
+    X(PFNGLCREATEQUERIESPROC, glCreateQueries) \
+    X(PFNGLDELETEQUERIESPROC, glDeleteQueries) \
+    X(PFNGLQUERYCOUNTERPROC, glQueryCounter) \
+    X(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v) \
+    X(PFNGLFENCESYNCPROC, glFenceSync) \
+    X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync) \
+    X(PFNGLDELETESYNCPROC, glDeleteSync) \
+    X(PFNGLFLUSHPROC, glFlush) \
+    X(PFNGLFINISHPROC, glFinish)
+
+#define X(type, name) static type name;
+GL_FUNCTIONS(X)
+#undef X
+// GL 4.6, falls back to ARB_indirect_parameters.
+static PFNGLMULTIDRAWARRAYSINDIRECTCOUNTPROC glMultiDrawArraysIndirectCount;
+
+struct DrawArraysIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t first;
+    uint32_t baseInstance;
+};
+
+// Adapter that lets RecordDraws() issue GL calls. The position uniform is at location 0.
+struct GlCommandList
+{
+    void
+    SetGraphicsRoot32BitConstants(uint32_t, uint32_t num32BitValues, const void* srcData, uint32_t destOffset)
+    {
+        assert(num32BitValues == 2 && destOffset == 0);
+        glUniform2fv(0, 1, (const float*)srcData);
+    }
+
+    void
+    DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex, uint32_t)
+    {
+        assert(instanceCount == 1);
+        glDrawArrays(GL_POINTS, startVertex, vertexCount);
+    }
+};
+
+struct GlBackend : Backend
+{
+    EGLDisplay display;
+    EGLContext context;
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    GLuint vertexArray;
+    GLuint program;
+    // Persistent mapped buffers, one region per frame in flight.
+    GLuint commandBuffer;
+    GLuint positionBuffer;
+    GLuint parameterBuffer;
+    DrawArraysIndirectCommand* commands;
+    float* positions;
+    uint32_t* drawCount;
+    GLsync frameSync[k_MaxNumFramesInFlight];
+    // GL_TIMESTAMP queries (nanoseconds), read after frameSync of the frame has been waited for.
+    GLuint timestampQueries[k_MaxNumFramesInFlight][GpuTimestamp_Count];
+    DrawMode mode;
+    uint32_t numThreads;
+    uint32_t numDraws;
+    uint32_t numFramesInFlight;
+    uint32_t frameIndex;
+    Workers* workers;
+    const FrameData* frame;
+
+    bool IsSupported(DrawMode mode) override;
+    bool Initialize(const Config& config, Workers* workers) override;
+    void Shutdown() override;
+    void Draw(const FrameData& frame, FrameTimings& timings) override;
+    void Present(FrameTimings& timings) override;
+    void Flush() override;
+    uint64_t GetCommandMemorySize() override;
+};
+
+static const char* s_VsTransformSource = R"(
+#if defined INDIRECT
+layout(location = 0) in vec2 a_Position;
+#else
+layout(location = 0) uniform vec2 u_Position;
+#endif
+
+void main()
+{
+#if defined INDIRECT
+    gl_Position = vec4(a_Position, 0.0, 1.0);
+#else
+    gl_Position = vec4(u_Position, 0.0, 1.0);
+#endif
+}
+)";
+
+static const char* s_PsShadeSource = R"(
+layout(location = 0) out vec4 o_Color;
+
+void main()
+{
+    o_Color = vec4(1.0, 1.0, 1.0, 1.0);
+}
+)";
+
+static GLuint
+CompileShader(GLenum type, const char* defines, const char* source)
+{
+    const char* sources[3] = { "#version 450 core\n", defines, source };
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 3, sources, nullptr);
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        fprintf(stderr, "%s\n", log);
+        assert(0);
+    }
+    return shader;
+}
+
+static bool
+InitializeGl(GlBackend& gl)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay)
+        return false;
+
+    gl.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (gl.display == EGL_NO_DISPLAY || !eglInitialize(gl.display, nullptr, nullptr))
+        return false;
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    // Prefer GL 4.6, llvmpipe may only expose 4.5 (+ ARB_indirect_parameters).
+    for (int minorVersion = 6; minorVersion >= 5 && !gl.context; --minorVersion)
+    {
+        const EGLint contextAttribs[] =
+        {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, minorVersion,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        gl.context = eglCreateContext(gl.display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    }
+    if (gl.context == EGL_NO_CONTEXT)
+        return false;
+    if (!eglMakeCurrent(gl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, gl.context))
+        return false;
+
+#define X(type, name) name = (type)eglGetProcAddress(#name); if (!name) return false;
+    GL_FUNCTIONS(X)
+#undef X
+    glMultiDrawArraysIndirectCount =
+        (PFNGLMULTIDRAWARRAYSINDIRECTCOUNTPROC)eglGetProcAddress("glMultiDrawArraysIndirectCount");
+    if (!glMultiDrawArraysIndirectCount)
+    {
+        glMultiDrawArraysIndirectCount =
+            (PFNGLMULTIDRAWARRAYSINDIRECTCOUNTPROC)eglGetProcAddress("glMultiDrawArraysIndirectCountARB");
+    }
+
+    printf("GL_RENDERER: %s\nGL_VERSION: %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    return true;
+}
+
+static void
+InitializeResources(GlBackend& gl)
+{
+    /* render target */ {
+        glCreateRenderbuffers(1, &gl.renderbuffer);
+        glNamedRenderbufferStorage(gl.renderbuffer, GL_RGBA8, k_DemoResolutionX, k_DemoResolutionY);
+        glCreateFramebuffers(1, &gl.framebuffer);
+        glNamedFramebufferRenderbuffer(gl.framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, gl.renderbuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gl.framebuffer);
+        glViewport(0, 0, k_DemoResolutionX, k_DemoResolutionY);
+    }
+
+    /* program */ {
+        const bool indirect = gl.mode != DrawMode_Loop;
+        GLuint vs = CompileShader(GL_VERTEX_SHADER, indirect ? "#define INDIRECT\n" : "", s_VsTransformSource);
+        GLuint ps = CompileShader(GL_FRAGMENT_SHADER, "", s_PsShadeSource);
+
+        gl.program = glCreateProgram();
+        glAttachShader(gl.program, vs);
+        glAttachShader(gl.program, ps);
+        glLinkProgram(gl.program);
+        glDeleteShader(vs);
+        glDeleteShader(ps);
+
+        GLint status;
+        glGetProgramiv(gl.program, GL_LINK_STATUS, &status);
+        assert(status);
+        (void)status;
+    }
+
+    glCreateVertexArrays(1, &gl.vertexArray);
+
+    if (gl.mode != DrawMode_Loop)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr commandSize = gl.numFramesInFlight * gl.numDraws * sizeof(DrawArraysIndirectCommand);
+        const GLsizeiptr positionSize = gl.numFramesInFlight * gl.numDraws * 2 * sizeof(float);
+        const GLsizeiptr parameterSize = gl.numFramesInFlight * sizeof(uint32_t);
+
+        glCreateBuffers(1, &gl.commandBuffer);
+        glNamedBufferStorage(gl.commandBuffer, commandSize, nullptr, flags);
+        gl.commands = (DrawArraysIndirectCommand*)glMapNamedBufferRange(gl.commandBuffer, 0, commandSize, flags);
+
+        glCreateBuffers(1, &gl.positionBuffer);
+        glNamedBufferStorage(gl.positionBuffer, positionSize, nullptr, flags);
+        gl.positions = (float*)glMapNamedBufferRange(gl.positionBuffer, 0, positionSize, flags);
+
+        glCreateBuffers(1, &gl.parameterBuffer);
+        glNamedBufferStorage(gl.parameterBuffer, parameterSize, nullptr, flags);
+        gl.drawCount = (uint32_t*)glMapNamedBufferRange(gl.parameterBuffer, 0, parameterSize, flags);
+
+        // One position per draw, fetched with baseInstance from the draw command.
+        glEnableVertexArrayAttrib(gl.vertexArray, 0);
+        glVertexArrayAttribFormat(gl.vertexArray, 0, 2, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(gl.vertexArray, 0, 0);
+        glVertexArrayBindingDivisor(gl.vertexArray, 0, 1);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl.commandBuffer);
+        glBindBuffer(GL_PARAMETER_BUFFER, gl.parameterBuffer);
+    }
+
+    glBindVertexArray(gl.vertexArray);
+    glUseProgram(gl.program);
+}
+
+// Writes draw commands and positions of one thread's draw range into this frame's region.
+static void
+WriteDrawRange(void* context, uint32_t threadIndex)
+{
+    GlBackend& gl = *(GlBackend*)context;
+    TRACE_ZONE("Write");
+    DrawArraysIndirectCommand* commands = gl.commands + gl.frameIndex * gl.numDraws;
+    float* positions = gl.positions + gl.frameIndex * gl.numDraws * 2;
+    const FrameData& frame = *gl.frame;
+
+    uint32_t begin, end;
+    GetDrawRange(gl.numDraws, gl.numThreads, threadIndex, begin, end);
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        positions[i * 2 + 0] = frame.positionX[i];
+        positions[i * 2 + 1] = frame.positionY[i];
+        commands[i] = { 1, 1, 0, i };
+    }
+}
+
+bool
+GlBackend::IsSupported(DrawMode drawMode)
+{
+    return drawMode == DrawMode_Loop || drawMode == DrawMode_MultiDrawIndirect ||
+           drawMode == DrawMode_MultiDrawIndirectCount;
+}
+
+bool
+GlBackend::Initialize(const Config& config, Workers* sharedWorkers)
+{
+    workers = sharedWorkers;
+    mode = config.mode;
+    // GL context is bound to one thread, only the indirect modes fill their buffers in parallel.
+    numThreads = config.numThreads;
+    numDraws = config.numDraws;
+    numFramesInFlight = config.numFramesInFlight;
+
+    if (!InitializeGl(*this))
+        return false;
+    if (mode == DrawMode_MultiDrawIndirectCount && !glMultiDrawArraysIndirectCount)
+        return false;
+    InitializeResources(*this);
+    glCreateQueries(GL_TIMESTAMP, numFramesInFlight * GpuTimestamp_Count, &timestampQueries[0][0]);
+    return true;
+}
+
+void
+GlBackend::Shutdown()
+{
+    for (uint32_t i = 0; i < numFramesInFlight; ++i)
+        if (frameSync[i])
+            glDeleteSync(frameSync[i]);
+    glDeleteQueries(numFramesInFlight * GpuTimestamp_Count, &timestampQueries[0][0]);
+    if (commands)
+    {
+        glUnmapNamedBuffer(commandBuffer);
+        glUnmapNamedBuffer(positionBuffer);
+        glUnmapNamedBuffer(parameterBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &positionBuffer);
+        glDeleteBuffers(1, &parameterBuffer);
+    }
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteProgram(program);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+void
+GlBackend::Draw(const FrameData& frameData, FrameTimings& timings)
+{
+    const double t0 = GetTime();
+    frame = &frameData;
+    GLuint* queries = timestampQueries[frameIndex];
+
+    glQueryCounter(queries[GpuTimestamp_FrameBegin], GL_TIMESTAMP);
+    glClearColor(0.0f, 0.2f, 0.4f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glQueryCounter(queries[GpuTimestamp_ClearEnd], GL_TIMESTAMP);
+
+    if (mode == DrawMode_Loop)
+    {
+        TRACE_ZONE("Record");
+        GlCommandList cl;
+        RecordProfiled(&cl, 0, [&](auto* recordCl) { RecordDraws(recordCl, frameData, 0, numDraws); });
+    }
+    else
+    {
+        RunWorkers(*workers, WriteDrawRange, this);
+        drawCount[frameIndex] = numDraws;
+
+        const GLintptr positionOffset = frameIndex * numDraws * 2 * sizeof(float);
+        const GLintptr commandOffset = frameIndex * numDraws * sizeof(DrawArraysIndirectCommand);
+
+        glVertexArrayVertexBuffer(vertexArray, 0, positionBuffer, positionOffset, 2 * sizeof(float));
+
+        if (mode == DrawMode_MultiDrawIndirect)
+            glMultiDrawArraysIndirect(GL_POINTS, (const void*)commandOffset, numDraws, 0);
+        else
+            glMultiDrawArraysIndirectCount(GL_POINTS, (const void*)commandOffset, frameIndex * sizeof(uint32_t),
+                                           numDraws, 0);
+    }
+    // Nothing follows the draws, the frame ends with them.
+    glQueryCounter(queries[GpuTimestamp_DrawsEnd], GL_TIMESTAMP);
+    glQueryCounter(queries[GpuTimestamp_FrameEnd], GL_TIMESTAMP);
+
+    const double t1 = GetTime();
+
+    /* submit */ {
+        TRACE_ZONE("Flush");
+        frameSync[frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+
+    const double t2 = GetTime();
+
+    timings.record = t1 - t0;
+    timings.submit = t2 - t1;
+}
+
+void
+GlBackend::Present(FrameTimings& timings)
+{
+    // At most numFramesInFlight frames in flight, the persistent mapped region of the next frame must be free.
+    frameIndex = (frameIndex + 1) % numFramesInFlight;
+    if (frameSync[frameIndex])
+    {
+        const double waitBegin = GetTime();
+        /* wait */ {
+            TRACE_ZONE("Wait");
+            glClientWaitSync(frameSync[frameIndex], GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        }
+        timings.wait = GetTime() - waitBegin;
+        glDeleteSync(frameSync[frameIndex]);
+        frameSync[frameIndex] = nullptr;
+
+        // The frame has completed, results are available without stalling.
+        uint64_t ticks[GpuTimestamp_Count];
+        for (uint32_t i = 0; i < GpuTimestamp_Count; ++i)
+            glGetQueryObjectui64v(timestampQueries[frameIndex][i], GL_QUERY_RESULT, &ticks[i]);
+        SetGpuTimings(timings, ticks, 1e9);
+    }
+}
+
+void
+GlBackend::Flush()
+{
+    glFinish();
+}
+
+uint64_t
+GlBackend::GetCommandMemorySize()
+{
+    if (mode == DrawMode_Loop)
+        return 0;
+    return (uint64_t)numFramesInFlight * numDraws * (sizeof(DrawArraysIndirectCommand) + 2 * sizeof(float));
+}
+
+Backend*
+CreateGlBackend()
+{
+    return new GlBackend();
+}
+// vim: set ts=4 sw=4 expandtab:
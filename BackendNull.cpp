@@ -0,0 +1,454 @@
+#include "Backend.h"
+
+// Null device: command lists encode calls into a compact in-memory command stream and the queue completes
+// fences immediately. Recording cost is the same code path as in the D3D12 backend (RecordDraws()), minus
+// the driver, so it can be benchmarked on machines without a GPU.
+
+enum NullOpcode : uint8_t
+{
+    NullOp_ClearRenderTarget,
+    NullOp_SetPipelineState,
+    NullOp_SetGraphicsRootSignature,
+    NullOp_IASetPrimitiveTopology,
+    NullOp_SetGraphicsRoot32BitConstants,
+    NullOp_SetGraphicsRootConstantBufferView,
+    NullOp_SetGraphicsRootShaderResourceView,
+    NullOp_SetGraphicsRootDescriptorTable,
+    NullOp_DrawInstanced,
+};
+
+struct NullDescriptorHandle
+{
+    uint64_t ptr;
+};
+
+struct NullCommandAllocator
+{
+    std::vector<uint8_t> memory;
+};
+
+struct NullCommandList
+{
+    NullCommandAllocator* alloc;
+    uint8_t* cursor;
+    uint8_t* end;
+    uint32_t size;
+
+    void
+    Reset(NullCommandAllocator* cmdAlloc)
+    {
+        alloc = cmdAlloc;
+        if (alloc->memory.empty())
+            alloc->memory.resize(64 * 1024);
+        cursor = alloc->memory.data();
+        end = cursor + alloc->memory.size();
+        size = 0;
+    }
+
+    void
+    Close()
+    {
+        size = (uint32_t)(cursor - alloc->memory.data());
+    }
+
+    uint8_t*
+    Allocate(uint32_t numBytes)
+    {
+        if (cursor + numBytes > end)
+        {
+            const size_t offset = cursor - alloc->memory.data();
+            alloc->memory.resize(alloc->memory.size() * 2 + numBytes);
+            cursor = alloc->memory.data() + offset;
+            end = alloc->memory.data() + alloc->memory.size();
+        }
+        uint8_t* ptr = cursor;
+        cursor += numBytes;
+        return ptr;
+    }
+
+    void
+    WriteOp(NullOpcode op, uint32_t value)
+    {
+        uint8_t* ptr = Allocate(1 + sizeof(value));
+        ptr[0] = op;
+        memcpy(ptr + 1, &value, sizeof(value));
+    }
+
+    void ClearRenderTarget() { WriteOp(NullOp_ClearRenderTarget, 0); }
+    void SetPipelineState(uint32_t pso) { WriteOp(NullOp_SetPipelineState, pso); }
+    void SetGraphicsRootSignature(uint32_t rootSig) { WriteOp(NullOp_SetGraphicsRootSignature, rootSig); }
+    void IASetPrimitiveTopology(uint32_t topology) { WriteOp(NullOp_IASetPrimitiveTopology, topology); }
+
+    // [op:8][rootIndex:8][num32BitValues:8][destOffset:8][values:32 x num32BitValues]
+    void
+    SetGraphicsRoot32BitConstants(uint32_t rootIndex, uint32_t num32BitValues, const void* srcData, uint32_t destOffset)
+    {
+        assert(rootIndex < 256 && num32BitValues < 256 && destOffset < 256);
+        uint8_t* ptr = Allocate(4 + num32BitValues * 4);
+        ptr[0] = NullOp_SetGraphicsRoot32BitConstants;
+        ptr[1] = (uint8_t)rootIndex;
+        ptr[2] = (uint8_t)num32BitValues;
+        ptr[3] = (uint8_t)destOffset;
+        memcpy(ptr + 4, srcData, num32BitValues * 4);
+    }
+
+    void
+    SetGraphicsRoot32BitConstant(uint32_t rootIndex, uint32_t srcData, uint32_t destOffset)
+    {
+        SetGraphicsRoot32BitConstants(rootIndex, 1, &srcData, destOffset);
+    }
+
+    // [op:8][rootIndex:8][address:64]
+    void
+    WriteRootAddress(NullOpcode op, uint32_t rootIndex, uint64_t address)
+    {
+        assert(rootIndex < 256);
+        uint8_t* ptr = Allocate(2 + sizeof(address));
+        ptr[0] = op;
+        ptr[1] = (uint8_t)rootIndex;
+        memcpy(ptr + 2, &address, sizeof(address));
+    }
+
+    void
+    SetGraphicsRootConstantBufferView(uint32_t rootIndex, uint64_t bufferLocation)
+    {
+        WriteRootAddress(NullOp_SetGraphicsRootConstantBufferView, rootIndex, bufferLocation);
+    }
+
+    void
+    SetGraphicsRootShaderResourceView(uint32_t rootIndex, uint64_t bufferLocation)
+    {
+        WriteRootAddress(NullOp_SetGraphicsRootShaderResourceView, rootIndex, bufferLocation);
+    }
+
+    void
+    SetGraphicsRootDescriptorTable(uint32_t rootIndex, NullDescriptorHandle baseDescriptor)
+    {
+        WriteRootAddress(NullOp_SetGraphicsRootDescriptorTable, rootIndex, baseDescriptor.ptr);
+    }
+
+    // [op:8][vertexCount:32][instanceCount:32][startVertex:32][startInstance:32]
+    void
+    DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance)
+    {
+        uint8_t* ptr = Allocate(1 + 16);
+        const uint32_t args[4] = { vertexCount, instanceCount, startVertex, startInstance };
+        ptr[0] = NullOp_DrawInstanced;
+        memcpy(ptr + 1, args, sizeof(args));
+    }
+};
+
+// Increment between descriptors of the fake CBV heap of the descriptor table mode.
+#define k_NullDescriptorSize 32
+
+struct NullBackend : Backend
+{
+    // One command list per thread, or per job with -jobsize, and frame in flight.
+    NullCommandAllocator cmdAlloc[k_MaxNumFramesInFlight][k_MaxNumJobs];
+    NullCommandList cmdList[k_MaxNumFramesInFlight][k_MaxNumJobs];
+    std::atomic<uint64_t> numReusedCmdLists;    // -dynamic: submitted again without recording
+    // Upload heaps of the binding modes, 'GPU' addresses are CPU pointers.
+    std::vector<uint8_t> uploadMemory;
+    UploadRing uploadRing;
+    std::vector<uint8_t> constantMemory;
+    std::vector<float> positionMemory;
+    std::vector<MergedInstance> instanceMemory;
+    DrawMode mode;
+    uint32_t numThreads;
+    uint32_t numDraws;
+    uint32_t numFramesInFlight;
+    uint32_t numCmdLists;
+    uint32_t jobSize;
+    JobSystem jobs;
+    uint8_t jobAffinity[k_MaxNumFramesInFlight][k_MaxNumJobs];  // worker that recorded the job's command list
+    bool stateFilter;
+    bool mergeDraws;
+    DrawMergeThread mergeThreads[k_MaxNumThreads];
+    DrawSort drawSort;
+    const DrawPacket* packets;                  // sort key mode: this frame's packets in recording order
+    uint32_t frameIndex;
+    uint64_t frameCount;
+    uint64_t completedFrameCount;
+    Workers* workers;
+    const FrameData* frame;
+
+    bool IsSupported(DrawMode mode) override;
+    bool Initialize(const Config& config, Workers* workers) override;
+    void Shutdown() override;
+    void Draw(const FrameData& frame, FrameTimings& timings) override;
+    void Present(FrameTimings& timings) override;
+    void Flush() override;
+    uint64_t GetCommandMemorySize() override;
+};
+
+// Records draws [begin, end) into command list 'cmdListIndex' on thread 'threadIndex'.
+static void
+RecordCommandList(NullBackend& nb, uint32_t cmdListIndex, uint32_t threadIndex, uint32_t begin, uint32_t end)
+{
+    if (CanReuseCommandList(nb.mode, *nb.frame, cmdListIndex, nb.numCmdLists, begin, end))
+    {
+        nb.numReusedCmdLists.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    NullCommandList* cl = &nb.cmdList[nb.frameIndex][cmdListIndex];
+    TRACE_ZONE("Record");
+
+    cl->Reset(&nb.cmdAlloc[nb.frameIndex][cmdListIndex]);
+
+    if (cmdListIndex == 0)
+        cl->ClearRenderTarget();
+
+    cl->SetPipelineState(1);
+    cl->SetGraphicsRootSignature(1);
+    cl->IASetPrimitiveTopology(1);
+
+    MergedInstance* instances = nb.instanceMemory.data() + (size_t)nb.frameIndex * nb.numDraws;
+    RecordProfiled(cl, threadIndex, [&](auto* recordCl) {
+        if (nb.mode == DrawMode_RootCbv)
+        {
+            RecordDrawsRootCbv(recordCl, nb.uploadRing, threadIndex, *nb.frame, begin, end);
+        }
+        else if (nb.mode == DrawMode_DescriptorTable)
+        {
+            const uint32_t firstSlot = nb.frameIndex * nb.numDraws;
+            const NullDescriptorHandle descriptors = { (uint64_t)firstSlot * k_NullDescriptorSize };
+            uint8_t* constants = nb.constantMemory.data() + (size_t)firstSlot * k_ConstantBufferAlignment;
+            RecordDrawsDescriptorTable(recordCl, constants, descriptors, k_NullDescriptorSize, *nb.frame, begin, end);
+        }
+        else if (nb.mode == DrawMode_SortKey)
+        {
+            // Object ids of the pipelines and root signatures, 1 is what the command list starts with.
+            static const uint32_t pipelines[k_NumSortRootSignatures * k_NumSortPipelines] = {
+                1, 2, 3, 4, 5, 6, 7, 8
+            };
+            static const uint32_t rootSigs[k_NumSortRootSignatures] = { 1, 2 };
+            uint64_t& numStateChanges = nb.drawSort.threads[threadIndex].numStateChanges;
+            if (nb.mergeDraws)
+            {
+                RecordMerged(recordCl, nb.mergeThreads[threadIndex], 1u, 1u, 1u, instances, (uint64_t)instances, begin,
+                             [&](auto* mergeCl) {
+                                 numStateChanges += RecordDrawPackets(mergeCl, pipelines, rootSigs, nb.packets, begin,
+                                                                      end);
+                             });
+            }
+            else
+            {
+                numStateChanges += RecordDrawPackets(recordCl, pipelines, rootSigs, nb.packets, begin, end);
+            }
+        }
+        else if (nb.mode == DrawMode_RootSrvIndex)
+        {
+            float* positions = nb.positionMemory.data() + (size_t)nb.frameIndex * nb.numDraws * 2;
+            recordCl->SetGraphicsRootShaderResourceView(1, (uint64_t)positions);
+            RecordDrawsRootSrvIndex(recordCl, positions, *nb.frame, begin, end);
+        }
+        else if (nb.mergeDraws)
+        {
+            RecordMerged(recordCl, nb.mergeThreads[threadIndex], 1u, 1u, 1u, instances, (uint64_t)instances, begin,
+                         [&](auto* mergeCl) {
+                             RecordDrawsFiltered(mergeCl, false, 1u, 1u, 1u, *nb.frame, begin, end);
+                         });
+        }
+        else
+        {
+            RecordDrawsFiltered(recordCl, nb.stateFilter, 1u, 1u, 1u, *nb.frame, begin, end);
+        }
+    });
+
+    cl->Close();
+}
+
+static void
+RecordDrawRange(void* context, uint32_t threadIndex)
+{
+    NullBackend& nb = *(NullBackend*)context;
+    uint32_t begin, end;
+    GetDrawRange(nb.numDraws, nb.numThreads, threadIndex, begin, end);
+    RecordCommandList(nb, threadIndex, threadIndex, begin, end);
+}
+
+static void
+RecordDrawJob(void* context, uint32_t jobIndex, uint32_t threadIndex)
+{
+    NullBackend& nb = *(NullBackend*)context;
+    const uint32_t begin = jobIndex * nb.jobSize;
+    RecordCommandList(nb, jobIndex, threadIndex, begin, std::min(begin + nb.jobSize, nb.numDraws));
+}
+
+// Walks the command stream like a driver would at submit time. Returns number of draws, instances of merged
+// draws count as draws.
+static uint32_t
+ExecuteCommandList(const NullCommandList& cl)
+{
+    const uint8_t* ptr = cl.alloc->memory.data();
+    const uint8_t* end = ptr + cl.size;
+    uint32_t numDraws = 0;
+
+    while (ptr < end)
+    {
+        switch (ptr[0])
+        {
+        case NullOp_ClearRenderTarget:
+        case NullOp_SetPipelineState:
+        case NullOp_SetGraphicsRootSignature:
+        case NullOp_IASetPrimitiveTopology:
+            ptr += 1 + 4;
+            break;
+        case NullOp_SetGraphicsRoot32BitConstants:
+            ptr += 4 + ptr[2] * 4;
+            break;
+        case NullOp_SetGraphicsRootConstantBufferView:
+        case NullOp_SetGraphicsRootShaderResourceView:
+        case NullOp_SetGraphicsRootDescriptorTable:
+            ptr += 2 + 8;
+            break;
+        case NullOp_DrawInstanced:
+        {
+            uint32_t instanceCount;
+            memcpy(&instanceCount, ptr + 1 + 4, sizeof(instanceCount));
+            ptr += 1 + 16;
+            numDraws += instanceCount;
+            break;
+        }
+        default:
+            assert(0);
+            return numDraws;
+        }
+    }
+    return numDraws;
+}
+
+bool
+NullBackend::IsSupported(DrawMode drawMode)
+{
+    return drawMode == DrawMode_Loop || drawMode == DrawMode_RootCbv || drawMode == DrawMode_DescriptorTable ||
+           drawMode == DrawMode_RootSrvIndex || drawMode == DrawMode_SortKey;
+}
+
+bool
+NullBackend::Initialize(const Config& config, Workers* sharedWorkers)
+{
+    workers = sharedWorkers;
+    mode = config.mode;
+    numThreads = config.numThreads;
+    numDraws = config.numDraws;
+    numFramesInFlight = config.numFramesInFlight;
+    stateFilter = config.stateFilter;
+    mergeDraws = config.mergeDraws && (mode == DrawMode_Loop || mode == DrawMode_SortKey);
+    numReusedCmdLists = 0;
+    jobSize = GetRecordJobSize(config.jobSize, numDraws);
+    numCmdLists = jobSize ? (numDraws + jobSize - 1) / jobSize : numThreads;
+    if (jobSize)
+    {
+        InitializeJobSystem(jobs, workers, numThreads);
+        for (uint32_t i = 0; i < k_MaxNumFramesInFlight; ++i)
+            InitializeJobAffinity(jobAffinity[i], numCmdLists, numThreads);
+    }
+
+    if (mode == DrawMode_RootCbv)
+    {
+        const uint64_t size = GetUploadRingSize((uint64_t)numDraws * k_ConstantBufferAlignment, numThreads,
+                                                numFramesInFlight);
+        uploadMemory.resize(size);
+        InitializeUploadRing(uploadRing, uploadMemory.data(), (uint64_t)uploadMemory.data(), size);
+    }
+    else if (mode == DrawMode_DescriptorTable)
+    {
+        constantMemory.resize((size_t)numFramesInFlight * numDraws * k_ConstantBufferAlignment);
+    }
+    else if (mode == DrawMode_RootSrvIndex)
+    {
+        positionMemory.resize((size_t)numFramesInFlight * numDraws * 2);
+    }
+    else if (mode == DrawMode_SortKey)
+    {
+        InitializeDrawSort(drawSort, numDraws, numThreads, !config.noSort);
+    }
+    if (mergeDraws)
+        instanceMemory.resize((size_t)numFramesInFlight * numDraws);
+    return true;
+}
+
+void
+NullBackend::Shutdown()
+{
+    if (mode == DrawMode_SortKey)
+        PrintDrawSortStats(drawSort);
+    if (mergeDraws)
+        PrintDrawMergeStats(mergeThreads, numThreads, frameCount);
+    if (numReusedCmdLists)
+        printf("cmdlists: reused_per_frame=%.1f of %u\n", (double)numReusedCmdLists / std::max(1ull,
+               (unsigned long long)frameCount), numCmdLists);
+    if (jobSize)
+        PrintJobStats(jobs);
+}
+
+void
+NullBackend::Draw(const FrameData& frameData, FrameTimings& timings)
+{
+    const double t0 = GetTime();
+    frame = &frameData;
+    if (mode == DrawMode_RootCbv)
+        BeginUploadFrame(uploadRing, completedFrameCount);
+    if (mode == DrawMode_SortKey)
+        packets = BuildDrawPackets(drawSort, *workers, frameData);
+    if (jobSize)
+    {
+        // Jobs stay on the worker that recorded them into this frame in flight's memory last time.
+        RunJobs(jobs, RecordDrawJob, this, numCmdLists, jobAffinity[frameIndex]);
+        GetJobStats(jobs, timings);
+    }
+    else
+    {
+        RunWorkers(*workers, RecordDrawRange, this);
+    }
+    if (mode == DrawMode_RootCbv)
+        EndUploadFrame(uploadRing, frameCount + 1);
+    const double t1 = GetTime();
+
+    uint32_t numExecuted = 0;
+    for (uint32_t i = 0; i < numCmdLists; ++i)
+    {
+        TRACE_ZONE("Execute");
+        numExecuted += ExecuteCommandList(cmdList[frameIndex][i]);
+    }
+    assert(numExecuted == frameData.numDraws);
+    (void)numExecuted;
+    const double t2 = GetTime();
+
+    timings.record = t1 - t0;
+    timings.submit = t2 - t1;
+}
+
+void
+NullBackend::Present(FrameTimings&)
+{
+    // Fences complete immediately, there is never anything to wait for.
+    completedFrameCount = ++frameCount;
+    frameIndex = (frameIndex + 1) % numFramesInFlight;
+}
+
+void
+NullBackend::Flush()
+{
+    completedFrameCount = frameCount;
+}
+
+uint64_t
+NullBackend::GetCommandMemorySize()
+{
+    uint64_t size = 0;
+    for (uint32_t f = 0; f < k_MaxNumFramesInFlight; ++f)
+        for (uint32_t i = 0; i < k_MaxNumJobs; ++i)
+            size += cmdAlloc[f][i].memory.capacity();
+    return size + uploadMemory.capacity() + constantMemory.capacity() + positionMemory.capacity() * sizeof(float) +
+           instanceMemory.capacity() * sizeof(MergedInstance);
+}
+
+Backend*
+CreateNullBackend()
+{
+    return new NullBackend();
+}
+// vim: set ts=4 sw=4 expandtab:
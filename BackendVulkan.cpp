@@ -0,0 +1,550 @@
+#include "Backend.h"
+#include <vulkan/vulkan.h>
+// Generated by Build.sh (glslangValidator --vn).
+#include "Shaders/VsTransform.spv.h"
+#include "Shaders/PsShade.spv.h"
+
+// Headless Vulkan backend (runs on Mesa lavapipe). Root constants are replaced with push constants. With
+// more than one thread (or -secondary) draws are recorded in parallel into secondary command buffers which
+// are executed from one primary command buffer.
+
+#define VKR(r) if ((r) != VK_SUCCESS) { assert(0); }
+
+// Adapter that lets RecordDraws() record into a Vulkan command buffer. Hot functions are fetched with
+// vkGetDeviceProcAddr to skip the loader trampoline.
+struct VulkanCommandList
+{
+    VkCommandBuffer cb;
+    VkPipelineLayout layout;
+    PFN_vkCmdPushConstants cmdPushConstants;
+    PFN_vkCmdDraw cmdDraw;
+
+    void
+    SetGraphicsRoot32BitConstants(uint32_t, uint32_t num32BitValues, const void* srcData, uint32_t destOffset)
+    {
+        cmdPushConstants(cb, layout, VK_SHADER_STAGE_VERTEX_BIT, destOffset * 4, num32BitValues * 4, srcData);
+    }
+
+    void
+    DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance)
+    {
+        cmdDraw(cb, vertexCount, instanceCount, startVertex, startInstance);
+    }
+};
+
+struct VulkanBackend : Backend
+{
+    VkInstance instance;
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    VkQueue queue;
+    uint32_t queueFamily;
+    VkImage colorImage;
+    VkDeviceMemory colorMemory;
+    VkImageView colorView;
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkCommandPool cmdPool[k_MaxNumFramesInFlight];
+    VkCommandBuffer cmdBuffer[k_MaxNumFramesInFlight];
+    VkCommandPool secondaryCmdPool[k_MaxNumFramesInFlight][k_MaxNumThreads];
+    VkCommandBuffer secondaryCmdBuffer[k_MaxNumFramesInFlight][k_MaxNumThreads];
+    VkFence frameFence[k_MaxNumFramesInFlight];
+    VkQueryPool timestampPool;              // GpuTimestamp_Count timestamps per frame in flight, optional
+    double timestampPeriod;                 // nanoseconds per tick
+    bool timestampsWritten[k_MaxNumFramesInFlight];
+    PFN_vkCmdPushConstants cmdPushConstants;
+    PFN_vkCmdDraw cmdDraw;
+    uint32_t numThreads;
+    uint32_t numDraws;
+    uint32_t numFramesInFlight;
+    uint32_t frameIndex;
+    bool secondary;
+    Workers* workers;
+    const FrameData* frame;
+
+    bool Initialize(const Config& config, Workers* workers) override;
+    void Shutdown() override;
+    void Draw(const FrameData& frame, FrameTimings& timings) override;
+    void Present(FrameTimings& timings) override;
+    void Flush() override;
+};
+
+static uint32_t
+FindMemoryType(VulkanBackend& vk, uint32_t typeBits, VkMemoryPropertyFlags flags)
+{
+    VkPhysicalDeviceMemoryProperties props;
+    vkGetPhysicalDeviceMemoryProperties(vk.physicalDevice, &props);
+
+    for (uint32_t i = 0; i < props.memoryTypeCount; ++i)
+        if ((typeBits & (1 << i)) && (props.memoryTypes[i].propertyFlags & flags) == flags)
+            return i;
+    for (uint32_t i = 0; i < props.memoryTypeCount; ++i)
+        if (typeBits & (1 << i))
+            return i;
+    assert(0);
+    return 0;
+}
+
+static VkShaderModule
+CreateShaderModule(VulkanBackend& vk, const uint32_t* code, size_t codeSize)
+{
+    VkShaderModuleCreateInfo createInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+    createInfo.codeSize = codeSize;
+    createInfo.pCode = code;
+
+    VkShaderModule module;
+    VKR(vkCreateShaderModule(vk.device, &createInfo, nullptr, &module));
+    return module;
+}
+
+static bool
+InitializeVulkan(VulkanBackend& vk)
+{
+    VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
+    appInfo.pApplicationName = k_DemoName;
+    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    VkInstanceCreateInfo instanceInfo = { VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+    instanceInfo.pApplicationInfo = &appInfo;
+    if (vkCreateInstance(&instanceInfo, nullptr, &vk.instance) != VK_SUCCESS)
+        return false;
+
+    uint32_t numPhysicalDevices = 1;
+    vkEnumeratePhysicalDevices(vk.instance, &numPhysicalDevices, &vk.physicalDevice);
+    if (numPhysicalDevices == 0)
+        return false;
+
+    /* device */ {
+        uint32_t numQueueFamilies = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(vk.physicalDevice, &numQueueFamilies, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(numQueueFamilies);
+        vkGetPhysicalDeviceQueueFamilyProperties(vk.physicalDevice, &numQueueFamilies, queueFamilies.data());
+
+        vk.queueFamily = ~0u;
+        for (uint32_t i = 0; i < numQueueFamilies; ++i)
+        {
+            if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            {
+                vk.queueFamily = i;
+                break;
+            }
+        }
+        if (vk.queueFamily == ~0u)
+            return false;
+
+        const float priority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+        queueInfo.queueFamilyIndex = vk.queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &priority;
+
+        VkDeviceCreateInfo deviceInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        if (vkCreateDevice(vk.physicalDevice, &deviceInfo, nullptr, &vk.device) != VK_SUCCESS)
+            return false;
+
+        vkGetDeviceQueue(vk.device, vk.queueFamily, 0, &vk.queue);
+        vk.cmdPushConstants = (PFN_vkCmdPushConstants)vkGetDeviceProcAddr(vk.device, "vkCmdPushConstants");
+        vk.cmdDraw = (PFN_vkCmdDraw)vkGetDeviceProcAddr(vk.device, "vkCmdDraw");
+    }
+
+    /* render target */ {
+        VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        imageInfo.extent = { k_DemoResolutionX, k_DemoResolutionY, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VKR(vkCreateImage(vk.device, &imageInfo, nullptr, &vk.colorImage));
+
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(vk.device, vk.colorImage, &memReqs);
+
+        VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+        allocInfo.allocationSize = memReqs.size;
+        allocInfo.memoryTypeIndex = FindMemoryType(vk, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VKR(vkAllocateMemory(vk.device, &allocInfo, nullptr, &vk.colorMemory));
+        VKR(vkBindImageMemory(vk.device, vk.colorImage, vk.colorMemory, 0));
+
+        VkImageViewCreateInfo viewInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+        viewInfo.image = vk.colorImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        VKR(vkCreateImageView(vk.device, &viewInfo, nullptr, &vk.colorView));
+    }
+
+    /* render pass */ {
+        VkAttachmentDescription attachment = {};
+        attachment.format = VK_FORMAT_R8G8B8A8_UNORM;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;   // cleared before the render pass, see Draw()
+        attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorRef;
+
+        // Frames in flight render to the same image, order their color writes (Draw() also orders them with
+        // the clear before the render pass).
+        VkSubpassDependency dependency = {};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &attachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+        VKR(vkCreateRenderPass(vk.device, &renderPassInfo, nullptr, &vk.renderPass));
+
+        VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+        framebufferInfo.renderPass = vk.renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &vk.colorView;
+        framebufferInfo.width = k_DemoResolutionX;
+        framebufferInfo.height = k_DemoResolutionY;
+        framebufferInfo.layers = 1;
+        VKR(vkCreateFramebuffer(vk.device, &framebufferInfo, nullptr, &vk.framebuffer));
+    }
+
+    /* command buffers */ {
+        VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = vk.queueFamily;
+
+        VkCommandBufferAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        allocInfo.commandBufferCount = 1;
+
+        VkFenceCreateInfo fenceInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (uint32_t i = 0; i < vk.numFramesInFlight; ++i)
+        {
+            VKR(vkCreateCommandPool(vk.device, &poolInfo, nullptr, &vk.cmdPool[i]));
+            allocInfo.commandPool = vk.cmdPool[i];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            VKR(vkAllocateCommandBuffers(vk.device, &allocInfo, &vk.cmdBuffer[i]));
+
+            // Command pools are externally synchronized, every recording thread needs its own.
+            for (uint32_t t = 0; vk.secondary && t < vk.numThreads; ++t)
+            {
+                VKR(vkCreateCommandPool(vk.device, &poolInfo, nullptr, &vk.secondaryCmdPool[i][t]));
+                allocInfo.commandPool = vk.secondaryCmdPool[i][t];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                VKR(vkAllocateCommandBuffers(vk.device, &allocInfo, &vk.secondaryCmdBuffer[i][t]));
+            }
+
+            VKR(vkCreateFence(vk.device, &fenceInfo, nullptr, &vk.frameFence[i]));
+        }
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(vk.physicalDevice, &props);
+    if (props.limits.timestampComputeAndGraphics)
+    {
+        VkQueryPoolCreateInfo queryPoolInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = vk.numFramesInFlight * GpuTimestamp_Count;
+        VKR(vkCreateQueryPool(vk.device, &queryPoolInfo, nullptr, &vk.timestampPool));
+        vk.timestampPeriod = props.limits.timestampPeriod;
+    }
+    return true;
+}
+
+static void
+InitializePipeline(VulkanBackend& vk)
+{
+    VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_VERTEX_BIT, 0, 2 * sizeof(float) };
+
+    VkPipelineLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VKR(vkCreatePipelineLayout(vk.device, &layoutInfo, nullptr, &vk.pipelineLayout));
+
+    VkShaderModule vsModule = CreateShaderModule(vk, g_VsTransformSpv, sizeof(g_VsTransformSpv));
+    VkShaderModule psModule = CreateShaderModule(vk, g_PsShadeSpv, sizeof(g_PsShadeSpv));
+
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vsModule;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = psModule;
+    stages[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
+    VkViewport viewport = { 0.0f, 0.0f, (float)k_DemoResolutionX, (float)k_DemoResolutionY, 0.0f, 1.0f };
+    VkRect2D scissor = { { 0, 0 }, { k_DemoResolutionX, k_DemoResolutionY } };
+
+    VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = &viewport;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = &scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blendAttachment = {};
+    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                     VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo blendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+    blendState.attachmentCount = 1;
+    blendState.pAttachments = &blendAttachment;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = stages;
+    pipelineInfo.pVertexInputState = &vertexInput;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisample;
+    pipelineInfo.pColorBlendState = &blendState;
+    pipelineInfo.layout = vk.pipelineLayout;
+    pipelineInfo.renderPass = vk.renderPass;
+    pipelineInfo.subpass = 0;
+    VKR(vkCreateGraphicsPipelines(vk.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &vk.pipeline));
+
+    vkDestroyShaderModule(vk.device, vsModule, nullptr);
+    vkDestroyShaderModule(vk.device, psModule, nullptr);
+}
+
+static void
+RecordSecondaryRange(void* context, uint32_t threadIndex)
+{
+    VulkanBackend& vk = *(VulkanBackend*)context;
+    VkCommandBuffer cb = vk.secondaryCmdBuffer[vk.frameIndex][threadIndex];
+    TRACE_ZONE("Record");
+
+    uint32_t begin, end;
+    GetDrawRange(vk.numDraws, vk.numThreads, threadIndex, begin, end);
+
+    VKR(vkResetCommandPool(vk.device, vk.secondaryCmdPool[vk.frameIndex][threadIndex], 0));
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+    inheritanceInfo.renderPass = vk.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = vk.framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VKR(vkBeginCommandBuffer(cb, &beginInfo));
+
+    // Pipeline state is not inherited by secondary command buffers, every thread has to bind it.
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.pipeline);
+
+    VulkanCommandList cl = { cb, vk.pipelineLayout, vk.cmdPushConstants, vk.cmdDraw };
+    RecordProfiled(&cl, threadIndex, [&](auto* recordCl) { RecordDraws(recordCl, *vk.frame, begin, end); });
+
+    VKR(vkEndCommandBuffer(cb));
+}
+
+bool
+VulkanBackend::Initialize(const Config& config, Workers* sharedWorkers)
+{
+    workers = sharedWorkers;
+    numThreads = config.numThreads;
+    numDraws = config.numDraws;
+    numFramesInFlight = config.numFramesInFlight;
+    secondary = config.secondary || numThreads > 1;
+
+    if (!InitializeVulkan(*this))
+        return false;
+    InitializePipeline(*this);
+    return true;
+}
+
+void
+VulkanBackend::Shutdown()
+{
+    if (timestampPool)
+        vkDestroyQueryPool(device, timestampPool, nullptr);
+    for (uint32_t i = 0; i < numFramesInFlight; ++i)
+    {
+        vkDestroyFence(device, frameFence[i], nullptr);
+        for (uint32_t t = 0; secondary && t < numThreads; ++t)
+            vkDestroyCommandPool(device, secondaryCmdPool[i][t], nullptr);
+        vkDestroyCommandPool(device, cmdPool[i], nullptr);
+    }
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyFramebuffer(device, framebuffer, nullptr);
+    vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyImageView(device, colorView, nullptr);
+    vkDestroyImage(device, colorImage, nullptr);
+    vkFreeMemory(device, colorMemory, nullptr);
+    vkDestroyDevice(device, nullptr);
+    vkDestroyInstance(instance, nullptr);
+}
+
+void
+VulkanBackend::Draw(const FrameData& frameData, FrameTimings& timings)
+{
+    const double t0 = GetTime();
+    frame = &frameData;
+
+    VkCommandBuffer cb = cmdBuffer[frameIndex];
+    VKR(vkResetCommandPool(device, cmdPool[frameIndex], 0));
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VKR(vkBeginCommandBuffer(cb, &beginInfo));
+
+    const uint32_t firstTimestamp = frameIndex * GpuTimestamp_Count;
+    if (timestampPool)
+    {
+        vkCmdResetQueryPool(cb, timestampPool, firstTimestamp, GpuTimestamp_Count);
+        vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool,
+                            firstTimestamp + GpuTimestamp_FrameBegin);
+    }
+
+    // The clear is a transfer before the render pass (which loads the image) so that it can be timed on its
+    // own, a load op clear can't be separated from the beginning of the render pass. The image is discarded
+    // (UNDEFINED) after the color writes of the previous frame.
+    /* clear */ {
+        VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = colorImage;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+
+        const VkClearColorValue clearColor = { { 0.0f, 0.2f, 0.4f, 1.0f } };
+        vkCmdClearColorImage(cb, colorImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1,
+                             &barrier.subresourceRange);
+        if (timestampPool)
+            vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, timestampPool,
+                                firstTimestamp + GpuTimestamp_ClearEnd);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    VkRenderPassBeginInfo renderPassBegin = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+    renderPassBegin.renderPass = renderPass;
+    renderPassBegin.framebuffer = framebuffer;
+    renderPassBegin.renderArea = { { 0, 0 }, { k_DemoResolutionX, k_DemoResolutionY } };
+
+    if (secondary)
+    {
+        vkCmdBeginRenderPass(cb, &renderPassBegin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        RunWorkers(*workers, RecordSecondaryRange, this);
+        vkCmdExecuteCommands(cb, numThreads, secondaryCmdBuffer[frameIndex]);
+    }
+    else
+    {
+        vkCmdBeginRenderPass(cb, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+        TRACE_ZONE("Record");
+        VulkanCommandList cl = { cb, pipelineLayout, cmdPushConstants, cmdDraw };
+        RecordProfiled(&cl, 0, [&](auto* recordCl) { RecordDraws(recordCl, frameData, 0, numDraws); });
+    }
+    vkCmdEndRenderPass(cb);
+    if (timestampPool)
+    {
+        vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool,
+                            firstTimestamp + GpuTimestamp_DrawsEnd);
+        vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool,
+                            firstTimestamp + GpuTimestamp_FrameEnd);
+        timestampsWritten[frameIndex] = true;
+    }
+    VKR(vkEndCommandBuffer(cb));
+
+    const double t1 = GetTime();
+
+    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cb;
+    /* submit */ {
+        TRACE_ZONE("vkQueueSubmit");
+        VKR(vkQueueSubmit(queue, 1, &submitInfo, frameFence[frameIndex]));
+    }
+
+    const double t2 = GetTime();
+
+    timings.record = t1 - t0;
+    timings.submit = t2 - t1;
+}
+
+void
+VulkanBackend::Present(FrameTimings& timings)
+{
+    // Same pipelining as the D3D12 backend: at most numFramesInFlight frames in flight.
+    frameIndex = (frameIndex + 1) % numFramesInFlight;
+    const double waitBegin = GetTime();
+    /* wait */ {
+        TRACE_ZONE("Wait");
+        VKR(vkWaitForFences(device, 1, &frameFence[frameIndex], VK_TRUE, UINT64_MAX));
+    }
+    timings.wait = GetTime() - waitBegin;
+    VKR(vkResetFences(device, 1, &frameFence[frameIndex]));
+
+    // The fence has been waited for, results are available.
+    if (timestampsWritten[frameIndex])
+    {
+        uint64_t ticks[GpuTimestamp_Count];
+        VKR(vkGetQueryPoolResults(device, timestampPool, frameIndex * GpuTimestamp_Count, GpuTimestamp_Count,
+                                  sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT));
+        SetGpuTimings(timings, ticks, 1e9 / timestampPeriod);
+    }
+}
+
+void
+VulkanBackend::Flush()
+{
+    vkDeviceWaitIdle(device);
+}
+
+Backend*
+CreateVulkanBackend()
+{
+    return new VulkanBackend();
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -2,13 +2,24 @@
 set NAME=100kDrawCalls
 set FXC=fxc.exe /Ges /O3 /WX /nologo /Qstrip_reflect /Qstrip_debug /Qstrip_priv
 
-if exist *.cso del *.cso
-%FXC% /D VS_TRANSFORM /E VsTransform /Fo VsTransform.cso /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
-%FXC% /D PS_SHADE /E PsShade /Fo PsShade.cso /T ps_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+rem Shaders are compiled into headers with the bytecode as const arrays, they are embedded in the executable.
+if not exist Shaders mkdir Shaders
+if exist Shaders\*.h del Shaders\*.h
+%FXC% /D VS_TRANSFORM /E VsTransform /Fh Shaders\VsTransform.h /Vn g_VsTransform /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+%FXC% /D VS_TRANSFORM_CBV /E VsTransform /Fh Shaders\VsTransformCbv.h /Vn g_VsTransformCbv /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+%FXC% /D VS_TRANSFORM_INSTANCED /E VsTransformInstanced /Fh Shaders\VsTransformInstanced.h /Vn g_VsTransformInstanced /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+%FXC% /D VS_TRANSFORM_TABLE /E VsTransform /Fh Shaders\VsTransformTable.h /Vn g_VsTransformTable /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+%FXC% /D VS_TRANSFORM_INDEXED /E VsTransformIndexed /Fh Shaders\VsTransformIndexed.h /Vn g_VsTransformIndexed /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+%FXC% /D VS_TRANSFORM_MERGED /E VsTransformMerged /Fh Shaders\VsTransformMerged.h /Vn g_VsTransformMerged /T vs_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+%FXC% /D PS_SHADE /E PsShade /Fh Shaders\PsShade.h /Vn g_PsShade /T ps_5_1 100kDrawCalls.hlsl & if errorlevel 1 goto :end
+
+rem set PROFILE=1 compiles in the command list interception layer (CommandListProfiler.h).
+set FLAGS=
+if defined PROFILE set FLAGS=/DPROFILE_COMMAND_LISTS
 
 if exist %NAME%.exe del %NAME%.exe
-cl /Zi /O2 /std:c++17 /EHsc %NAME%.cpp /link kernel32.lib user32.lib gdi32.lib /incremental:no /opt:ref
-if exist %NAME%.obj del %NAME%.obj
+cl /Zi /O2 /std:c++17 /EHsc %FLAGS% %NAME%.cpp Common.cpp Trace.cpp DrawSort.cpp Jobs.cpp Scene.cpp BackendDx12.cpp BackendNull.cpp /Fe%NAME%.exe /link kernel32.lib user32.lib gdi32.lib /incremental:no /opt:ref
+if exist *.obj del *.obj
 if "%1" == "run" if exist %NAME%.exe (.\%NAME%.exe)
 
 :end
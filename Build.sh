@@ -0,0 +1,37 @@
+#!/bin/sh
+# Linux build: null backend, plus the Vulkan backend when Vulkan headers and glslangValidator are installed
+# and the OpenGL backend when EGL is installed.
+NAME=100kDrawCalls
+CXX=${CXX:-g++}
+# Built on the machine that runs the benchmark, enables the AVX2 paths of FillRandom() and
+# IntegrateParticles() where available.
+ARCH=${ARCH:--march=native}
+SOURCES="$NAME.cpp Common.cpp Trace.cpp DrawSort.cpp Jobs.cpp Scene.cpp BackendNull.cpp"
+FLAGS=""
+LIBS=""
+
+if pkg-config --exists vulkan && command -v glslangValidator > /dev/null; then
+    # SPIR-V is compiled into headers with the code as const arrays, it is embedded in the executable.
+    mkdir -p Shaders
+    rm -f Shaders/*.spv.h
+    glslangValidator -V -S vert -DVS_TRANSFORM --vn g_VsTransformSpv -o Shaders/VsTransform.spv.h $NAME.glsl > /dev/null || exit 1
+    glslangValidator -V -S frag -DPS_SHADE --vn g_PsShadeSpv -o Shaders/PsShade.spv.h $NAME.glsl > /dev/null || exit 1
+    SOURCES="$SOURCES BackendVulkan.cpp"
+    FLAGS="$FLAGS -DHAS_VULKAN"
+    LIBS="$LIBS $(pkg-config --libs vulkan)"
+fi
+
+if pkg-config --exists egl; then
+    SOURCES="$SOURCES BackendGl.cpp"
+    FLAGS="$FLAGS -DHAS_OPENGL"
+    LIBS="$LIBS $(pkg-config --libs egl)"
+fi
+
+# PROFILE=1 ./Build.sh compiles in the command list interception layer (CommandListProfiler.h).
+if [ -n "$PROFILE" ]; then
+    FLAGS="$FLAGS -DPROFILE_COMMAND_LISTS"
+fi
+
+rm -f $NAME
+$CXX -O2 -g -std=c++17 -pthread $ARCH $FLAGS -o $NAME $SOURCES $LIBS || exit 1
+if [ "$1" = "run" ]; then ./$NAME; fi
@@ -0,0 +1,227 @@
+#pragma once
+#include "Common.h"
+
+// Command list interception layer, compiled in with PROFILE_COMMAND_LISTS (Build.sh/Build.bat: set PROFILE=1).
+// Draws are recorded through ProfiledCommandList, which counts calls of every method and times every
+// k_CommandListSampleInterval-th call with ReadTicks() (rdtsc on x86). Without PROFILE_COMMAND_LISTS
+// RecordProfiled() passes the command list through unchanged and nothing here is compiled into the recording loops.
+#ifdef PROFILE_COMMAND_LISTS
+#if defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif !defined(__aarch64__)
+#include <chrono>
+#endif
+
+#define k_CommandListSampleInterval 16
+
+// Cheapest monotonic counter of the CPU: rdtsc on x86, the virtual counter on ARM64, steady_clock (ns)
+// elsewhere. Ticks are converted to time with a rate measured at run time, the unit doesn't matter.
+static inline uint64_t
+ReadTicks()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(_M_ARM64)
+    return (uint64_t)_ReadStatusReg(ARM64_CNTVCT);
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+enum CommandListCall
+{
+    CommandListCall_SetPipelineState,
+    CommandListCall_SetGraphicsRootSignature,
+    CommandListCall_IASetPrimitiveTopology,
+    CommandListCall_SetGraphicsRoot32BitConstants,
+    CommandListCall_SetGraphicsRoot32BitConstant,
+    CommandListCall_SetGraphicsRootConstantBufferView,
+    CommandListCall_SetGraphicsRootShaderResourceView,
+    CommandListCall_SetGraphicsRootDescriptorTable,
+    CommandListCall_DrawInstanced,
+    CommandListCall_Count
+};
+
+static const char* s_CommandListCallNames[CommandListCall_Count] = {
+    "SetPipelineState",
+    "SetGraphicsRootSignature",
+    "IASetPrimitiveTopology",
+    "SetGraphicsRoot32BitConstants",
+    "SetGraphicsRoot32BitConstant",
+    "SetGraphicsRootConstantBufferView",
+    "SetGraphicsRootShaderResourceView",
+    "SetGraphicsRootDescriptorTable",
+    "DrawInstanced",
+};
+
+// Written only by its recording thread, aligned to a cache line so that threads never share one.
+struct alignas(64) CommandListCallStats
+{
+    uint64_t count[CommandListCall_Count];
+    uint64_t samples[CommandListCall_Count];
+    uint64_t ticks[CommandListCall_Count];          // ReadTicks() ticks of the sampled calls
+};
+
+struct CommandListProfile
+{
+    CommandListCallStats threads[k_MaxNumThreads];
+    uint64_t beginTicks;
+    double beginTime;
+    double overheadTicks;                           // cost of the ReadTicks() pair around an empty call
+};
+
+inline CommandListProfile g_CommandListProfile;
+
+template <typename CommandList>
+struct ProfiledCommandList
+{
+    CommandList* cl;
+    CommandListCallStats* stats;
+
+    template <typename Function>
+    void
+    Call(CommandListCall call, Function function)
+    {
+        if (stats->count[call]++ % k_CommandListSampleInterval != 0)
+        {
+            function();
+            return;
+        }
+        const uint64_t begin = ReadTicks();
+        function();
+        stats->ticks[call] += ReadTicks() - begin;
+        stats->samples[call]++;
+    }
+
+    template <typename... Args>
+    void
+    SetPipelineState(Args... args)
+    {
+        Call(CommandListCall_SetPipelineState, [&] { cl->SetPipelineState(args...); });
+    }
+
+    template <typename... Args>
+    void
+    SetGraphicsRootSignature(Args... args)
+    {
+        Call(CommandListCall_SetGraphicsRootSignature, [&] { cl->SetGraphicsRootSignature(args...); });
+    }
+
+    template <typename... Args>
+    void
+    IASetPrimitiveTopology(Args... args)
+    {
+        Call(CommandListCall_IASetPrimitiveTopology, [&] { cl->IASetPrimitiveTopology(args...); });
+    }
+
+    template <typename... Args>
+    void
+    SetGraphicsRoot32BitConstants(Args... args)
+    {
+        Call(CommandListCall_SetGraphicsRoot32BitConstants, [&] { cl->SetGraphicsRoot32BitConstants(args...); });
+    }
+
+    template <typename... Args>
+    void
+    SetGraphicsRoot32BitConstant(Args... args)
+    {
+        Call(CommandListCall_SetGraphicsRoot32BitConstant, [&] { cl->SetGraphicsRoot32BitConstant(args...); });
+    }
+
+    template <typename... Args>
+    void
+    SetGraphicsRootConstantBufferView(Args... args)
+    {
+        Call(CommandListCall_SetGraphicsRootConstantBufferView,
+             [&] { cl->SetGraphicsRootConstantBufferView(args...); });
+    }
+
+    template <typename... Args>
+    void
+    SetGraphicsRootShaderResourceView(Args... args)
+    {
+        Call(CommandListCall_SetGraphicsRootShaderResourceView,
+             [&] { cl->SetGraphicsRootShaderResourceView(args...); });
+    }
+
+    template <typename... Args>
+    void
+    SetGraphicsRootDescriptorTable(Args... args)
+    {
+        Call(CommandListCall_SetGraphicsRootDescriptorTable, [&] { cl->SetGraphicsRootDescriptorTable(args...); });
+    }
+
+    template <typename... Args>
+    void
+    DrawInstanced(Args... args)
+    {
+        Call(CommandListCall_DrawInstanced, [&] { cl->DrawInstanced(args...); });
+    }
+};
+
+// Clears all counters, called before the first measured frame.
+static inline void
+ResetCommandListProfile()
+{
+    CommandListProfile& profile = g_CommandListProfile;
+    memset(profile.threads, 0, sizeof(profile.threads));
+
+    uint64_t overhead = 0;
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        const uint64_t begin = ReadTicks();
+        overhead += ReadTicks() - begin;
+    }
+    profile.overheadTicks = overhead / 1000.0;
+    profile.beginTicks = ReadTicks();
+    profile.beginTime = GetTime();
+}
+
+// Prints calls per frame and the average cost of every method called since ResetCommandListProfile().
+// Ticks are converted to time with the rate measured over the same interval.
+static inline void
+PrintCommandListProfile(uint32_t numFrames)
+{
+    const CommandListProfile& profile = g_CommandListProfile;
+    const double ticksPerNs = (ReadTicks() - profile.beginTicks) / ((GetTime() - profile.beginTime) * 1e9);
+
+    for (uint32_t call = 0; call < CommandListCall_Count; ++call)
+    {
+        uint64_t count = 0, samples = 0, ticks = 0;
+        for (const CommandListCallStats& stats : profile.threads)
+        {
+            count += stats.count[call];
+            samples += stats.samples[call];
+            ticks += stats.ticks[call];
+        }
+        if (count == 0)
+            continue;
+
+        const double ticksPerCall = std::max(0.0, (double)ticks / samples - profile.overheadTicks);
+        printf("command_list_profile: call=%s calls_per_frame=%.0f ns_per_call=%.2f\n", s_CommandListCallNames[call],
+               (double)count / std::max(1u, numFrames), ticksPerCall / ticksPerNs);
+    }
+}
+#endif
+
+// Calls 'record' with 'cl', wrapped in a ProfiledCommandList when PROFILE_COMMAND_LISTS is defined. 'record'
+// is a generic lambda, the draw loops are instantiated for the wrapper.
+template <typename CommandList, typename Record>
+static inline void
+RecordProfiled(CommandList* cl, uint32_t threadIndex, Record record)
+{
+#ifdef PROFILE_COMMAND_LISTS
+    ProfiledCommandList<CommandList> profiled = { cl, &g_CommandListProfile.threads[threadIndex] };
+    record(&profiled);
+#else
+    (void)threadIndex;
+    record(cl);
+#endif
+}
+// vim: set ts=4 sw=4 expandtab:
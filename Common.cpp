@@ -0,0 +1,394 @@
+#include "Common.h"
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+double
+GetTime()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER startCounter;
+    static LARGE_INTEGER frequency;
+    if (startCounter.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&startCounter);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (counter.QuadPart - startCounter.QuadPart) / (double)frequency.QuadPart;
+#else
+    static timespec start;
+    if (start.tv_sec == 0 && start.tv_nsec == 0)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+#endif
+}
+
+uint64_t
+GetProcessMemoryUsage()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters));
+    return counters.PrivateUsage;
+#else
+    unsigned long long size = 0, resident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    if (fscanf(file, "%llu %llu", &size, &resident) != 2)
+        resident = 0;
+    fclose(file);
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static const char* s_DrawModeNames[DrawMode_Count] =
+{
+    "loop",
+    "mdi",
+    "mdicount",
+    "executeindirect",
+    "instanced",
+    "bundle",
+    "rootcbv",
+    "table",
+    "rootsrv",
+    "sortkey",
+};
+
+const char*
+GetDrawModeName(DrawMode mode)
+{
+    assert(mode < DrawMode_Count);
+    return s_DrawModeNames[mode];
+}
+
+DrawMode
+FindDrawMode(const char* name)
+{
+    for (uint32_t i = 0; i < DrawMode_Count; ++i)
+        if (strcmp(name, s_DrawModeNames[i]) == 0)
+            return (DrawMode)i;
+    return DrawMode_Count;
+}
+
+FrameTimings
+GetAverageTimings(const std::vector<FrameTimings>& frames)
+{
+    FrameTimings average = {};
+    if (frames.empty())
+        return average;
+
+    for (const FrameTimings& frame : frames)
+    {
+        average.update += frame.update;
+        average.record += frame.record;
+        average.submit += frame.submit;
+        average.present += frame.present;
+        average.wait += frame.wait;
+        average.gpuClear += frame.gpuClear;
+        average.gpuDraws += frame.gpuDraws;
+        average.gpuFrame += frame.gpuFrame;
+        average.jobSteals += frame.jobSteals;
+        average.jobIdle += frame.jobIdle;
+        average.jobImbalance += frame.jobImbalance;
+    }
+    const double scale = 1.0 / frames.size();
+    average.update *= scale;
+    average.record *= scale;
+    average.submit *= scale;
+    average.present *= scale;
+    average.wait *= scale;
+    average.gpuClear *= scale;
+    average.gpuDraws *= scale;
+    average.gpuFrame *= scale;
+    average.jobSteals *= scale;
+    average.jobIdle *= scale;
+    average.jobImbalance *= scale;
+    return average;
+}
+
+double
+GetFrameTime(const FrameTimings& timings)
+{
+    return timings.update + timings.record + timings.submit + timings.present;
+}
+
+void
+PrintResults(const Config& config, const std::vector<FrameTimings>& frames)
+{
+    if (frames.empty())
+        return;
+
+    const FrameTimings average = GetAverageTimings(frames);
+
+    // The frame is GPU bound when the GPU takes longer than the CPU work (everything but waiting for the GPU).
+    const double cpuTime = GetFrameTime(average) - average.wait;
+    const char* bound = average.gpuFrame == 0.0 ? "unknown" : average.gpuFrame > cpuTime ? "gpu" : "cpu";
+
+    printf("backend=%s mode=%s threads=%u secondary=%u frames_in_flight=%u draws=%u frames=%u update_ms=%.3f "
+           "record_ms=%.3f submit_ms=%.3f present_ms=%.3f wait_ms=%.3f frame_ms=%.3f record_ns_per_draw=%.2f "
+           "gpu_draws_ms=%.3f gpu_frame_ms=%.3f bound=%s redundancy=%.2f state_filter=%u job_size=%u job_steals=%.1f "
+           "job_imbalance=%.3f\n",
+           config.backend, GetDrawModeName(config.mode), config.numThreads, config.secondary ? 1 : 0,
+           config.numFramesInFlight, config.numDraws, (uint32_t)frames.size(), average.update * 1000.0,
+           average.record * 1000.0, average.submit * 1000.0, average.present * 1000.0, average.wait * 1000.0,
+           GetFrameTime(average) * 1000.0, average.record * 1e9 / config.numDraws, average.gpuDraws * 1000.0,
+           average.gpuFrame * 1000.0, bound, config.redundancy, config.stateFilter ? 1 : 0, config.jobSize,
+           average.jobSteals, average.jobImbalance);
+}
+
+struct TimingMetric
+{
+    const char* name;
+    double (*get)(const FrameTimings& timings);
+    double scale;                       // 1000 for times (seconds to milliseconds), 1 for counts and ratios
+};
+
+static const TimingMetric s_TimingMetrics[] =
+{
+    { "update_ms", [](const FrameTimings& t) { return t.update; }, 1000.0 },
+    { "record_ms", [](const FrameTimings& t) { return t.record; }, 1000.0 },
+    { "submit_ms", [](const FrameTimings& t) { return t.submit; }, 1000.0 },
+    { "present_ms", [](const FrameTimings& t) { return t.present; }, 1000.0 },
+    { "wait_ms", [](const FrameTimings& t) { return t.wait; }, 1000.0 },
+    { "frame_ms", GetFrameTime, 1000.0 },
+    { "gpu_clear_ms", [](const FrameTimings& t) { return t.gpuClear; }, 1000.0 },
+    { "gpu_draws_ms", [](const FrameTimings& t) { return t.gpuDraws; }, 1000.0 },
+    { "gpu_frame_ms", [](const FrameTimings& t) { return t.gpuFrame; }, 1000.0 },
+    { "job_steals", [](const FrameTimings& t) { return t.jobSteals; }, 1.0 },
+    { "job_idle_ms", [](const FrameTimings& t) { return t.jobIdle; }, 1000.0 },
+    { "job_imbalance", [](const FrameTimings& t) { return t.jobImbalance; }, 1.0 },
+};
+#define k_NumTimingMetrics (sizeof(s_TimingMetrics) / sizeof(s_TimingMetrics[0]))
+
+static const char* s_StatNames[] = { "min", "median", "p95", "p99", "mean", "max" };
+#define k_NumStats (sizeof(s_StatNames) / sizeof(s_StatNames[0]))
+
+// Nearest-rank percentile of sorted values.
+static double
+GetPercentile(const std::vector<double>& sorted, double percentile)
+{
+    const size_t rank = (size_t)ceil(percentile / 100.0 * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+// Fills o_Stats (milliseconds, in s_StatNames order) for one metric over all frames.
+static void
+GetTimingStats(const std::vector<FrameTimings>& frames, const TimingMetric& metric, double o_Stats[k_NumStats])
+{
+    std::vector<double> sorted(frames.size());
+    double sum = 0.0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        sorted[i] = metric.get(frames[i]) * metric.scale;
+        sum += sorted[i];
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    o_Stats[0] = sorted.front();
+    o_Stats[1] = GetPercentile(sorted, 50.0);
+    o_Stats[2] = GetPercentile(sorted, 95.0);
+    o_Stats[3] = GetPercentile(sorted, 99.0);
+    o_Stats[4] = sum / sorted.size();
+    o_Stats[5] = sorted.back();
+}
+
+static void
+WriteResultsJson(FILE* file, const std::vector<RunResults>& runs)
+{
+    fprintf(file, "{\n  \"runs\": [\n");
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        const Config& config = runs[r].config;
+        const std::vector<FrameTimings>& frames = runs[r].frames;
+
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"backend\": \"%s\", \"mode\": \"%s\", \"threads\": %u, \"secondary\": %s, "
+                "\"frames_in_flight\": %u, \"draws\": %u, \"bundles\": %u, \"warmup_frames\": %u, "
+                "\"measured_frames\": %u,\n",
+                config.backend, GetDrawModeName(config.mode), config.numThreads, config.secondary ? "true" : "false",
+                config.numFramesInFlight, config.numDraws, config.numBundles, config.numWarmupFrames,
+                (uint32_t)frames.size());
+        fprintf(file, "      \"redundancy\": %.3f, \"state_filter\": %s, \"no_sort\": %s, \"job_size\": %u, "
+                "\"merge_draws\": %s, \"sim_thread\": %s, \"dynamic\": %.4f, \"particles\": %s,\n",
+                config.redundancy, config.stateFilter ? "true" : "false", config.noSort ? "true" : "false",
+                config.jobSize, config.mergeDraws ? "true" : "false", config.simThread ? "true" : "false",
+                config.dynamic, config.particles ? "true" : "false");
+        fprintf(file, "      \"init_ms\": %.6f, \"command_memory_bytes\": %llu, "
+                "\"process_memory_growth_bytes\": %lld,\n",
+                runs[r].initTime * 1000.0, (unsigned long long)runs[r].commandMemorySize,
+                (long long)runs[r].processMemoryGrowth);
+
+        fprintf(file, "      \"summary\": {\n");
+        for (size_t m = 0; m < k_NumTimingMetrics; ++m)
+        {
+            double stats[k_NumStats] = {};
+            if (!frames.empty())
+                GetTimingStats(frames, s_TimingMetrics[m], stats);
+
+            fprintf(file, "        \"%s\": {", s_TimingMetrics[m].name);
+            for (size_t i = 0; i < k_NumStats; ++i)
+                fprintf(file, "%s\"%s\": %.6f", i ? ", " : " ", s_StatNames[i], stats[i]);
+            fprintf(file, " }%s\n", m + 1 < k_NumTimingMetrics ? "," : "");
+        }
+        fprintf(file, "      },\n");
+
+        fprintf(file, "      \"frames\": [\n");
+        for (size_t f = 0; f < frames.size(); ++f)
+        {
+            fprintf(file, "        {");
+            for (size_t m = 0; m < k_NumTimingMetrics; ++m)
+                fprintf(file, "%s\"%s\": %.6f", m ? ", " : " ", s_TimingMetrics[m].name,
+                        s_TimingMetrics[m].get(frames[f]) * s_TimingMetrics[m].scale);
+            fprintf(file, " }%s\n", f + 1 < frames.size() ? "," : "");
+        }
+        fprintf(file, "      ]\n");
+        fprintf(file, "    }%s\n", r + 1 < runs.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+// One row per measured frame, followed by one row per statistic ('frame' column holds its name).
+static void
+WriteResultsCsv(FILE* file, const std::vector<RunResults>& runs)
+{
+    fprintf(file, "backend,mode,threads,secondary,frames_in_flight,draws,redundancy,state_filter,no_sort,job_size,"
+            "merge_draws,sim_thread,dynamic,particles,frame");
+    for (size_t m = 0; m < k_NumTimingMetrics; ++m)
+        fprintf(file, ",%s", s_TimingMetrics[m].name);
+    fprintf(file, "\n");
+
+    for (const RunResults& run : runs)
+    {
+        const Config& config = run.config;
+        char prefix[256];
+        snprintf(prefix, sizeof(prefix), "%s,%s,%u,%u,%u,%u,%.3f,%u,%u,%u,%u,%u,%.4f,%u", config.backend,
+                 GetDrawModeName(config.mode), config.numThreads, config.secondary ? 1 : 0, config.numFramesInFlight,
+                 config.numDraws, config.redundancy, config.stateFilter ? 1 : 0, config.noSort ? 1 : 0,
+                 config.jobSize, config.mergeDraws ? 1 : 0, config.simThread ? 1 : 0, config.dynamic,
+                 config.particles ? 1 : 0);
+
+        for (size_t f = 0; f < run.frames.size(); ++f)
+        {
+            fprintf(file, "%s,%u", prefix, (uint32_t)f);
+            for (size_t m = 0; m < k_NumTimingMetrics; ++m)
+                fprintf(file, ",%.6f", s_TimingMetrics[m].get(run.frames[f]) * s_TimingMetrics[m].scale);
+            fprintf(file, "\n");
+        }
+        if (run.frames.empty())
+            continue;
+
+        double stats[k_NumTimingMetrics][k_NumStats];
+        for (size_t m = 0; m < k_NumTimingMetrics; ++m)
+            GetTimingStats(run.frames, s_TimingMetrics[m], stats[m]);
+        for (size_t i = 0; i < k_NumStats; ++i)
+        {
+            fprintf(file, "%s,%s", prefix, s_StatNames[i]);
+            for (size_t m = 0; m < k_NumTimingMetrics; ++m)
+                fprintf(file, ",%.6f", stats[m][i]);
+            fprintf(file, "\n");
+        }
+    }
+}
+
+bool
+WriteResults(const char* fileName, const std::vector<RunResults>& runs)
+{
+    FILE* file = fopen(fileName, "w");
+    if (!file)
+        return false;
+
+    const char* extension = strrchr(fileName, '.');
+    if (extension && strcmp(extension, ".csv") == 0)
+        WriteResultsCsv(file, runs);
+    else
+        WriteResultsJson(file, runs);
+
+    fclose(file);
+    return true;
+}
+
+static void
+WorkerThread(Workers& workers, uint32_t threadIndex)
+{
+    uint64_t generation = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(workers.mutex);
+            workers.startCv.wait(lock, [&] { return workers.quit || workers.generation != generation; });
+            if (workers.quit)
+                return;
+            generation = workers.generation;
+        }
+
+        workers.job(workers.context, threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(workers.mutex);
+            if (--workers.numPending == 0)
+                workers.doneCv.notify_one();
+        }
+    }
+}
+
+void
+StartWorkers(Workers& workers, uint32_t numThreads)
+{
+    // Workers may be restarted with a different number of threads (-sweepthreads).
+    assert(workers.threads.empty());
+    workers.generation = 0;
+    workers.quit = false;
+    for (uint32_t t = 1; t < numThreads; ++t)
+        workers.threads.push_back(std::thread(WorkerThread, std::ref(workers), t));
+}
+
+void
+StopWorkers(Workers& workers)
+{
+    {
+        std::lock_guard<std::mutex> lock(workers.mutex);
+        workers.quit = true;
+    }
+    workers.startCv.notify_all();
+    for (std::thread& thread : workers.threads)
+        thread.join();
+    workers.threads.clear();
+}
+
+void
+RunWorkers(Workers& workers, WorkerJob job, void* context)
+{
+    if (!workers.threads.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers.mutex);
+            workers.job = job;
+            workers.context = context;
+            workers.numPending = (uint32_t)workers.threads.size();
+            workers.generation++;
+        }
+        workers.startCv.notify_all();
+    }
+
+    job(context, 0);
+
+    if (!workers.threads.empty())
+    {
+        std::unique_lock<std::mutex> lock(workers.mutex);
+        workers.doneCv.wait(lock, [&] { return workers.numPending == 0; });
+    }
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,235 @@
+#pragma once
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <execution>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define k_DemoName "100k Draw Calls in Parallel"
+#define k_DemoResolutionX 1280
+#define k_DemoResolutionY 720
+#define k_NumDraws 100000 // default, -draws overrides it
+#define k_MaxNumThreads 64
+#define k_MaxNumFramesInFlight 4
+
+// How the draws are submitted. Not every backend supports every mode.
+enum DrawMode
+{
+    DrawMode_Loop,                      // one draw call (and one constant update) per point
+    DrawMode_MultiDrawIndirect,         // gl: glMultiDrawArraysIndirect from a persistent mapped buffer
+    DrawMode_MultiDrawIndirectCount,    // gl: glMultiDrawArraysIndirectCount, draw count read from a buffer
+    DrawMode_ExecuteIndirect,           // dx12: one ExecuteIndirect, root constants + draw per command
+    DrawMode_Instanced,                 // dx12: one DrawInstanced, positions in a structured buffer
+    DrawMode_Bundle,                    // dx12: draws recorded once into bundles, replayed with ExecuteBundle
+    DrawMode_RootCbv,                   // dx12, null: constants suballocated from an upload ring, root CBV per draw
+    DrawMode_DescriptorTable,           // dx12, null: descriptor table into a shader-visible CBV heap per draw
+    DrawMode_RootSrvIndex,              // dx12, null: positions in a root SRV, index root constant per draw
+    DrawMode_SortKey,                   // dx12, null: radix-sorted draw packets, several PSOs and materials
+    DrawMode_Count
+};
+
+struct Config
+{
+    const char* backend;
+    DrawMode mode;
+    uint32_t numThreads;
+    uint32_t numFramesInFlight; // 1-4, 0 runs all depths and reports the difference
+    uint32_t numDraws;
+    uint32_t numBundles;        // bundle mode: draws are split into this many bundles
+    uint32_t numWarmupFrames;   // run before measuring, not included in results
+    uint32_t numFrames;         // measured frames, 0 runs until the window is closed
+    const char* output;         // results file (.json or .csv), null if not requested
+    const char* trace;          // Chrome trace of CPU zones, null if not requested
+    double redundancy;          // loop mode: fraction of draws that repeat the state of the previous draw
+    bool stateFilter;           // loop mode: drop redundant state changes while recording
+    bool noSort;                // sort key mode: record packets unsorted, in draw order
+    bool mergeDraws;            // loop and sort key modes: merge runs of draws with the same state into instanced draws
+    double dynamic;             // fraction of the scene's objects that move per frame, 1 regenerates all of them
+    bool particles;             // scene objects have a velocity and bounce inside the box, all move every frame
+    bool simThread;             // generate draw data on a producer thread, one frame ahead of recording
+    uint32_t jobSize;           // draws per work-stealing recording job, 0 records one range per thread
+    const char* pipelineCache;  // dx12: pipeline library file, null disables the cache
+    bool headless;
+    bool secondary;
+    bool randomBenchmark;
+    bool compareBindings;       // run every root binding mode and compare them
+    bool compareStartup;        // Initialize() time with a cold and with a warm pipeline cache
+    bool sweep;                 // 1k-10M draws, fit of fixed and per-draw cost
+    bool sweepThreads;          // sweep also thread counts, fit of the serial fraction
+};
+
+// Per-draw data of one frame, generated before recording. Positions are stored as SoA.
+struct FrameData
+{
+    uint32_t numDraws;
+    const float* positionX;
+    const float* positionY;
+    uint64_t redundantDrawThreshold;    // see IsRedundantDraw(), 0 if the workload has no redundant draws
+    // Bit i set: position of draw i has changed since the per-draw data of this frame in flight was last written
+    // (Scene::stale). nullptr if every draw has changed.
+    const uint64_t* dirty;
+};
+
+// CPU time (seconds) spent in each phase of a frame. Every backend fills these the same way so results are
+// comparable: 'update' is generation of FrameData, 'record' is command recording (all threads, wall clock),
+// 'submit' is the queue submission and 'present' is Present() including 'wait', the time blocked on the
+// GPU because the maximum number of frames was in flight.
+// 'gpu*' are measured with timestamp queries and read back without stalling, once the frame's fence has
+// completed. They belong to the latest completed frame (up to numFramesInFlight frames behind) and are 0 when
+// the backend has no timestamps or no frame has completed yet.
+struct FrameTimings
+{
+    double update;
+    double record;
+    double submit;
+    double present;
+    double wait;
+    double gpuClear;
+    double gpuDraws;
+    double gpuFrame;
+    // Work-stealing recording (-jobsize): jobs stolen, idle time summed over all workers (seconds) and load
+    // imbalance, max / mean busy time of the workers - 1. 0 without jobs.
+    double jobSteals;
+    double jobIdle;
+    double jobImbalance;
+};
+
+// Measured frames of one run.
+struct RunResults
+{
+    Config config;
+    std::vector<FrameTimings> frames;
+    double initTime;                // Backend::Initialize(), seconds
+    uint64_t commandMemorySize;     // Backend::GetCommandMemorySize() after the last frame
+    int64_t processMemoryGrowth;    // from before Initialize() to after the last frame
+};
+
+typedef void (*WorkerJob)(void* context, uint32_t threadIndex);
+
+struct Workers
+{
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCv;
+    std::condition_variable doneCv;
+    WorkerJob job;
+    void* context;
+    uint64_t generation;
+    uint32_t numPending;
+    bool quit;
+};
+
+// Returns [begin, end) range of draws recorded by thread 'threadIndex'.
+static inline void
+GetDrawRange(uint32_t numDraws, uint32_t numThreads, uint32_t threadIndex, uint32_t& o_Begin, uint32_t& o_End)
+{
+    const uint32_t drawsPerThread = (numDraws + numThreads - 1) / numThreads;
+    o_Begin = std::min(threadIndex * drawsPerThread, numDraws);
+    o_End = std::min(o_Begin + drawsPerThread, numDraws);
+}
+
+// Cheap integer hash, used to give every draw index stable pseudo-random properties.
+static inline uint32_t
+HashUint32(uint32_t x)
+{
+    x *= 0x9e3779b9u;
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    return x;
+}
+
+// Threshold for IsRedundantDraw() that makes a fraction 'redundancy' (0-1) of the draws redundant.
+static inline uint64_t
+GetRedundantDrawThreshold(double redundancy)
+{
+    return (uint64_t)(std::min(std::max(redundancy, 0.0), 1.0) * 4294967296.0);
+}
+
+// Redundant draws (-redundancy) set the same pipeline state, root signature and topology again and repeat the
+// constants (position) of the previous draw. Which draws are redundant depends only on the index, generation
+// and recording agree on it without sharing any data.
+static inline bool
+IsRedundantDraw(uint32_t drawIndex, uint64_t threshold)
+{
+    return HashUint32(drawIndex) < threshold;
+}
+
+static inline uint32_t
+CountTrailingZeros64(uint64_t x)
+{
+    assert(x != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctzll(x);
+#endif
+}
+
+static inline uint32_t
+PopCount64(uint64_t x)
+{
+#ifdef _MSC_VER
+    return (uint32_t)__popcnt64(x);
+#else
+    return (uint32_t)__builtin_popcountll(x);
+#endif
+}
+
+static inline bool
+IsDrawDirty(const uint64_t* dirty, uint32_t drawIndex)
+{
+    return !dirty || ((dirty[drawIndex >> 6] >> (drawIndex & 63)) & 1);
+}
+
+// Returns true if any draw in [begin, end) is dirty (see FrameData::dirty).
+static inline bool
+IsDrawRangeDirty(const uint64_t* dirty, uint32_t begin, uint32_t end)
+{
+    if (!dirty)
+        return true;
+    for (uint32_t i = begin; i < end;)
+    {
+        const uint32_t bit = i & 63;
+        const uint32_t count = std::min(64 - bit, end - i);
+        const uint64_t mask = count == 64 ? ~0ull : ((1ull << count) - 1) << bit;
+        if (dirty[i >> 6] & mask)
+            return true;
+        i += count;
+    }
+    return false;
+}
+
+double GetTime();
+// Private (Windows) or resident (elsewhere) memory of the process in bytes.
+uint64_t GetProcessMemoryUsage();
+const char* GetDrawModeName(DrawMode mode);
+// Returns DrawMode_Count if 'name' is not a known mode.
+DrawMode FindDrawMode(const char* name);
+FrameTimings GetAverageTimings(const std::vector<FrameTimings>& frames);
+// Wall-clock time of the frame (sum of all phases, 'wait' is part of 'present').
+double GetFrameTime(const FrameTimings& timings);
+// Prints one line in a format shared by all backends.
+void PrintResults(const Config& config, const std::vector<FrameTimings>& frames);
+// Writes per-frame timings and min/median/p95/p99/mean/max of every phase, in milliseconds. CSV if the file
+// name ends with .csv, JSON otherwise. Returns false if the file can't be created.
+bool WriteResults(const char* fileName, const std::vector<RunResults>& runs);
+
+// Thread 0 is the calling thread, StartWorkers() creates numThreads - 1 additional threads.
+void StartWorkers(Workers& workers, uint32_t numThreads);
+void StopWorkers(Workers& workers);
+// Runs 'job' on all threads and returns when every thread is done.
+void RunWorkers(Workers& workers, WorkerJob job, void* context);
+// vim: set ts=4 sw=4 expandtab:
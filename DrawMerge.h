@@ -0,0 +1,174 @@
+#pragma once
+#include "Common.h"
+
+// Root constants of RootSig (position and material), written per instance by the merging recorder.
+#define k_NumMergedRootConstants 3
+
+// Per-instance constants of a merged draw, VsTransformMerged reads them indexed by first instance + SV_InstanceID.
+struct MergedInstance
+{
+    uint32_t constants[k_NumMergedRootConstants];
+};
+
+// Written only by its thread.
+struct alignas(64) DrawMergeThread
+{
+    uint64_t numDraws;
+    uint64_t numMergedDraws;
+};
+
+// Recorder that coalesces runs of draws with the same pipeline state, root signature and topology that differ
+// only in their root constants into one instanced draw. The root constants a draw would have set are written
+// into this frame's instance buffer instead, at one slot per draw from 'firstSlot' (the first draw of the
+// range, so ranges recorded in parallel don't overlap). Pipelines are created with VsTransformMerged and
+// RootSigMerged: root parameter 0 is the first instance of the run, 1 the instance buffer (root SRV). Content
+// records as if root parameter 0 held the k_NumMergedRootConstants root constants of RootSig. State calls that
+// would not change state are dropped; Flush() records the pending run and must be called before the command
+// list is closed.
+template <typename CommandList, typename PipelineState, typename RootSignature, typename Topology>
+struct DrawMergeCommandList
+{
+    CommandList* cl;
+    PipelineState pipelineState;
+    RootSignature rootSignature;
+    Topology topology;
+    MergedInstance* instances;                  // this frame's instance buffer
+    uint64_t instanceBufferAddress;             // GPU address of 'instances'
+    MergedInstance constants;                   // root constants set so far, copied into every instance
+    uint32_t firstInstance;                     // pending run
+    uint32_t numInstances;
+    uint32_t vertexCount;
+    uint32_t startVertex;
+    bool bindInstances;                         // root SRV is lost when the root signature changes
+    uint64_t numDraws;
+    uint64_t numMergedDraws;
+
+    void
+    Reset(CommandList* commandList, PipelineState pso, RootSignature rootSig, Topology primitiveTopology,
+          MergedInstance* instanceBuffer, uint64_t instanceBufferGpuAddress, uint32_t firstSlot)
+    {
+        cl = commandList;
+        pipelineState = pso;
+        rootSignature = rootSig;
+        topology = primitiveTopology;
+        instances = instanceBuffer;
+        instanceBufferAddress = instanceBufferGpuAddress;
+        constants = {};
+        firstInstance = firstSlot;
+        numInstances = 0;
+        bindInstances = true;
+        numDraws = 0;
+        numMergedDraws = 0;
+    }
+
+    void
+    Flush()
+    {
+        if (numInstances == 0)
+            return;
+        if (bindInstances)
+        {
+            cl->SetGraphicsRootShaderResourceView(1, instanceBufferAddress);
+            bindInstances = false;
+        }
+        cl->SetGraphicsRoot32BitConstant(0, firstInstance, 0);
+        cl->DrawInstanced(vertexCount, numInstances, startVertex, 0);
+        firstInstance += numInstances;
+        numInstances = 0;
+        numMergedDraws++;
+    }
+
+    void
+    SetPipelineState(PipelineState pso)
+    {
+        if (pso == pipelineState)
+            return;
+        Flush();
+        pipelineState = pso;
+        cl->SetPipelineState(pso);
+    }
+
+    void
+    SetGraphicsRootSignature(RootSignature rootSig)
+    {
+        if (rootSig == rootSignature)
+            return;
+        Flush();
+        rootSignature = rootSig;
+        bindInstances = true;
+        cl->SetGraphicsRootSignature(rootSig);
+    }
+
+    void
+    IASetPrimitiveTopology(Topology primitiveTopology)
+    {
+        if (primitiveTopology == topology)
+            return;
+        Flush();
+        topology = primitiveTopology;
+        cl->IASetPrimitiveTopology(primitiveTopology);
+    }
+
+    // Root constants don't end a run, they only change what the following instances get.
+    void
+    SetGraphicsRoot32BitConstants(uint32_t rootIndex, uint32_t num32BitValues, const void* srcData, uint32_t destOffset)
+    {
+        assert(rootIndex == 0 && destOffset + num32BitValues <= k_NumMergedRootConstants);
+        (void)rootIndex;
+        memcpy(constants.constants + destOffset, srcData, num32BitValues * 4);
+    }
+
+    void
+    SetGraphicsRoot32BitConstant(uint32_t rootIndex, uint32_t srcData, uint32_t destOffset)
+    {
+        SetGraphicsRoot32BitConstants(rootIndex, 1, &srcData, destOffset);
+    }
+
+    void
+    DrawInstanced(uint32_t drawVertexCount, uint32_t instanceCount, uint32_t drawStartVertex, uint32_t startInstance)
+    {
+        assert(instanceCount == 1 && startInstance == 0);
+        (void)instanceCount;
+        (void)startInstance;
+        if (numInstances && (drawVertexCount != vertexCount || drawStartVertex != startVertex))
+            Flush();
+        vertexCount = drawVertexCount;
+        startVertex = drawStartVertex;
+        instances[firstInstance + numInstances] = constants; // upload heap is write-combined, write whole instances
+        numInstances++;
+        numDraws++;
+    }
+};
+
+// Calls record(mergeCl) with a DrawMergeCommandList on top of 'cl' that starts with the state BeginCommandList()
+// has set, records the last run and adds the draws to 'stats'.
+template <typename CommandList, typename PipelineState, typename RootSignature, typename Topology, typename Record>
+static inline void
+RecordMerged(CommandList* cl, DrawMergeThread& stats, PipelineState pso, RootSignature rootSig, Topology topology,
+             MergedInstance* instances, uint64_t instanceBufferAddress, uint32_t firstSlot, Record record)
+{
+    DrawMergeCommandList<CommandList, PipelineState, RootSignature, Topology> merged;
+    merged.Reset(cl, pso, rootSig, topology, instances, instanceBufferAddress, firstSlot);
+    record(&merged);
+    merged.Flush();
+    stats.numDraws += merged.numDraws;
+    stats.numMergedDraws += merged.numMergedDraws;
+}
+
+// Prints draws recorded by the content and draws submitted after merging per frame, call once after the last
+// frame.
+static inline void
+PrintDrawMergeStats(const DrawMergeThread* threads, uint32_t numThreads, uint64_t numFrames)
+{
+    uint64_t numDraws = 0, numMergedDraws = 0;
+    for (uint32_t t = 0; t < numThreads; ++t)
+    {
+        numDraws += threads[t].numDraws;
+        numMergedDraws += threads[t].numMergedDraws;
+    }
+    const double scale = 1.0 / std::max(1ull, (unsigned long long)numFrames);
+    printf("mergedraws: draws_per_frame=%.0f merged_draws_per_frame=%.1f draws_per_merged_draw=%.1f\n",
+           numDraws * scale, numMergedDraws * scale,
+           (double)numDraws / std::max(1ull, (unsigned long long)numMergedDraws));
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,138 @@
+#include "DrawSort.h"
+#include "Trace.h"
+
+void
+InitializeDrawSort(DrawSort& ds, uint32_t numDraws, uint32_t numThreads, bool sort)
+{
+    ds.packets.resize(numDraws);
+    ds.scratch.resize(numDraws);
+    memset(ds.threads, 0, sizeof(ds.threads));
+    ds.numDraws = numDraws;
+    ds.numThreads = numThreads;
+    ds.sort = sort;
+    ds.numFrames = 0;
+    ds.numSkippedPasses = 0;
+}
+
+// Pipeline and material are properties of the object a draw renders and don't change between frames, depth
+// follows the position.
+static void
+EmitPacketRange(void* context, uint32_t threadIndex)
+{
+    DrawSort& ds = *(DrawSort*)context;
+    const FrameData& frame = *ds.frame;
+
+    uint32_t begin, end;
+    GetDrawRange(ds.numDraws, ds.numThreads, threadIndex, begin, end);
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const uint32_t h = HashUint32(i);
+        const float y = std::min(std::max(frame.positionY[i] * 0.5f + 0.5f, 0.0f), 1.0f);
+        const uint32_t depth = (uint32_t)(y * ((1 << k_SortDepthBits) - 1));
+
+        DrawPacket& packet = ds.packets[i];
+        packet.key = MakeSortKey(h & 1, (h >> 1) & 3, (h >> 8) & 0xff, depth);
+        packet.position[0] = frame.positionX[i];
+        packet.position[1] = frame.positionY[i];
+    }
+}
+
+static void
+CountDigitRange(void* context, uint32_t threadIndex)
+{
+    DrawSort& ds = *(DrawSort*)context;
+    DrawSortThread& thread = ds.threads[threadIndex];
+
+    uint32_t begin, end;
+    GetDrawRange(ds.numDraws, ds.numThreads, threadIndex, begin, end);
+
+    memset(thread.histogram, 0, sizeof(thread.histogram));
+    for (uint32_t i = begin; i < end; ++i)
+        thread.histogram[(ds.source[i].key >> ds.shift) & ((1 << k_SortRadixBits) - 1)]++;
+}
+
+// Every thread scatters its range in order, digits of lower threads go first: the pass is stable.
+static void
+ScatterDigitRange(void* context, uint32_t threadIndex)
+{
+    DrawSort& ds = *(DrawSort*)context;
+    DrawSortThread& thread = ds.threads[threadIndex];
+
+    uint32_t begin, end;
+    GetDrawRange(ds.numDraws, ds.numThreads, threadIndex, begin, end);
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const DrawPacket& packet = ds.source[i];
+        ds.destination[thread.offsets[(packet.key >> ds.shift) & ((1 << k_SortRadixBits) - 1)]++] = packet;
+    }
+}
+
+#ifndef NDEBUG
+static bool
+HasSingleDigit(const DrawPacket* packets, uint32_t numDraws, uint32_t shift)
+{
+    for (uint32_t i = 1; i < numDraws; ++i)
+        if (((packets[i].key ^ packets[0].key) >> shift) & ((1 << k_SortRadixBits) - 1))
+            return false;
+    return true;
+}
+#endif
+
+const DrawPacket*
+BuildDrawPackets(DrawSort& ds, Workers& workers, const FrameData& frame)
+{
+    ds.frame = &frame;
+    ds.numFrames++;
+    /* emit */ {
+        TRACE_ZONE("Emit");
+        RunWorkers(workers, EmitPacketRange, &ds);
+    }
+    if (!ds.sort)
+        return ds.packets.data();
+
+    TRACE_ZONE("Sort");
+    ds.source = ds.packets.data();
+    ds.destination = ds.scratch.data();
+    for (ds.shift = 0; ds.shift < k_SortKeyBits; ds.shift += k_SortRadixBits)
+    {
+        RunWorkers(workers, CountDigitRange, &ds);
+
+        // A digit that all keys have can only be seen in the sum over all threads.
+        uint32_t offset = 0;
+        bool singleDigit = false;
+        for (uint32_t digit = 0; digit < (1 << k_SortRadixBits); ++digit)
+        {
+            const uint32_t digitBegin = offset;
+            for (uint32_t t = 0; t < ds.numThreads; ++t)
+            {
+                ds.threads[t].offsets[digit] = offset;
+                offset += ds.threads[t].histogram[digit];
+            }
+            singleDigit |= offset - digitBegin == ds.numDraws;
+        }
+        assert(singleDigit == HasSingleDigit(ds.source, ds.numDraws, ds.shift));
+        if (singleDigit)
+        {
+            ds.numSkippedPasses++;
+            continue;
+        }
+
+        RunWorkers(workers, ScatterDigitRange, &ds);
+        std::swap(ds.source, ds.destination);
+    }
+    return ds.source;
+}
+
+void
+PrintDrawSortStats(const DrawSort& ds)
+{
+    uint64_t numStateChanges = 0;
+    for (uint32_t t = 0; t < ds.numThreads; ++t)
+        numStateChanges += ds.threads[t].numStateChanges;
+    const double scale = 1.0 / std::max(1ull, (unsigned long long)ds.numFrames);
+    printf("sortkey: sort=%u state_changes_per_frame=%.0f skipped_passes_per_frame=%.1f\n", ds.sort ? 1 : 0,
+           numStateChanges * scale, ds.numSkippedPasses * scale);
+}
+// vim: set ts=4 sw=4 expandtab:
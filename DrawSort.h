@@ -0,0 +1,106 @@
+#pragma once
+#include "Common.h"
+
+// Sort key mode: every draw is emitted as a packet with a 64-bit sort key and its constants, the packets are
+// radix-sorted in parallel and recorded in key order, setting state only when it changes between packets.
+#define k_NumSortRootSignatures 2
+#define k_NumSortPipelines 4                // per root signature
+#define k_NumSortMaterials 256
+#define k_SortDepthBits 24
+#define k_SortKeyBits (1 + 2 + 8 + k_SortDepthBits)
+#define k_SortRadixBits 8
+
+// Key, most significant bits first: root signature (1 bit), pipeline (2), material (8), depth (24).
+static inline uint64_t
+MakeSortKey(uint32_t rootSig, uint32_t pipeline, uint32_t material, uint32_t depth)
+{
+    return ((uint64_t)rootSig << 34) | ((uint64_t)pipeline << 32) | ((uint64_t)material << k_SortDepthBits) | depth;
+}
+
+static inline uint32_t GetSortKeyRootSignature(uint64_t key) { return (uint32_t)(key >> 34) & 1; }
+// Index into the k_NumSortRootSignatures * k_NumSortPipelines pipelines, pipelines of a root signature are
+// created with it.
+static inline uint32_t GetSortKeyPipeline(uint64_t key) { return (uint32_t)(key >> 32) & 7; }
+static inline uint32_t GetSortKeyMaterial(uint64_t key) { return (uint32_t)(key >> k_SortDepthBits) & 0xff; }
+
+struct DrawPacket
+{
+    uint64_t key;
+    float position[2];
+};
+
+// Written only by its thread.
+struct alignas(64) DrawSortThread
+{
+    uint32_t histogram[1 << k_SortRadixBits];
+    uint32_t offsets[1 << k_SortRadixBits];     // scatter position of every digit in the current pass
+    uint64_t numStateChanges;
+};
+
+struct DrawSort
+{
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> scratch;
+    DrawSortThread threads[k_MaxNumThreads];
+    const FrameData* frame;
+    DrawPacket* source;                         // current radix pass
+    DrawPacket* destination;
+    uint32_t shift;
+    uint32_t numDraws;
+    uint32_t numThreads;
+    bool sort;                                  // false records the packets in emission (draw) order
+    uint64_t numFrames;
+    uint64_t numSkippedPasses;
+};
+
+void InitializeDrawSort(DrawSort& ds, uint32_t numDraws, uint32_t numThreads, bool sort);
+// Emits the packets of 'frame' and sorts them by key (LSD radix sort, one pass per 8 key bits, passes where
+// all keys have the same digit are skipped). Returns the packets in recording order.
+const DrawPacket* BuildDrawPackets(DrawSort& ds, Workers& workers, const FrameData& frame);
+// Prints state changes and skipped radix passes per frame, call once after the last frame.
+void PrintDrawSortStats(const DrawSort& ds);
+
+// Records packets [begin, end). The command list starts with pipeline 0 and root signature 0 set
+// (BeginCommandList()), the material is a root constant after the position. Returns the number of state
+// changes.
+template <typename CommandList, typename PipelineState, typename RootSignature>
+static inline uint64_t
+RecordDrawPackets(CommandList* cl, const PipelineState* pipelines, const RootSignature* rootSigs,
+                  const DrawPacket* packets, uint32_t begin, uint32_t end)
+{
+    uint32_t rootSig = 0;
+    uint32_t pipeline = 0;
+    uint32_t material = UINT32_MAX;
+    uint64_t numStateChanges = 0;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const DrawPacket& packet = packets[i];
+        const uint32_t packetRootSig = GetSortKeyRootSignature(packet.key);
+        const uint32_t packetPipeline = GetSortKeyPipeline(packet.key);
+        const uint32_t packetMaterial = GetSortKeyMaterial(packet.key);
+        if (packetRootSig != rootSig)
+        {
+            // Root arguments are lost when the root signature changes.
+            cl->SetGraphicsRootSignature(rootSigs[packetRootSig]);
+            rootSig = packetRootSig;
+            material = UINT32_MAX;
+            numStateChanges++;
+        }
+        if (packetPipeline != pipeline)
+        {
+            cl->SetPipelineState(pipelines[packetPipeline]);
+            pipeline = packetPipeline;
+            numStateChanges++;
+        }
+        if (packetMaterial != material)
+        {
+            cl->SetGraphicsRoot32BitConstant(0, packetMaterial, 2);
+            material = packetMaterial;
+            numStateChanges++;
+        }
+        cl->SetGraphicsRoot32BitConstants(0, 2, packet.position, 0);
+        cl->DrawInstanced(1, 1, 0, 0);
+    }
+    return numStateChanges;
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,71 @@
+#pragma once
+#include "Common.h"
+#include <atomic>
+
+// Frame N is recorded while frame N + 1 is simulated.
+#define k_NumFramePackets 2
+
+// Draw data of one frame, written by the simulation thread.
+struct FramePacket
+{
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    double simulateTime;                // seconds the producer spent generating it
+};
+
+// Bounded single-producer/single-consumer queue of preallocated frame packets, used in place: the producer
+// fills the packet at 'tail' and publishes it by advancing tail, the consumer reads the packet at 'head' and
+// gives it back by advancing head once it is done with it. Each index is written by one side only, neither
+// side takes a lock. Indices are monotonic, the packet is index % k_NumFramePackets.
+struct FrameQueue
+{
+    FramePacket packets[k_NumFramePackets];
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+};
+
+static inline void
+InitializeFrameQueue(FrameQueue& queue, uint32_t numDraws)
+{
+    for (FramePacket& packet : queue.packets)
+    {
+        packet.positionX.resize(numDraws);
+        packet.positionY.resize(numDraws);
+    }
+    queue.head.store(0, std::memory_order_relaxed);
+    queue.tail.store(0, std::memory_order_relaxed);
+}
+
+// Producer: returns the packet to fill, nullptr when all packets are queued or being read.
+static inline FramePacket*
+TryBeginWrite(FrameQueue& queue)
+{
+    const uint64_t tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail - queue.head.load(std::memory_order_acquire) == k_NumFramePackets)
+        return nullptr;
+    return &queue.packets[tail % k_NumFramePackets];
+}
+
+static inline void
+EndWrite(FrameQueue& queue)
+{
+    queue.tail.store(queue.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Consumer: returns the oldest queued packet, nullptr when the queue is empty.
+static inline FramePacket*
+TryBeginRead(FrameQueue& queue)
+{
+    const uint64_t head = queue.head.load(std::memory_order_relaxed);
+    if (queue.tail.load(std::memory_order_acquire) == head)
+        return nullptr;
+    return &queue.packets[head % k_NumFramePackets];
+}
+
+// The packet returned by TryBeginRead() can be refilled after this.
+static inline void
+EndRead(FrameQueue& queue)
+{
+    queue.head.store(queue.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,189 @@
+#include "Jobs.h"
+
+static inline uint64_t
+MakeJobRange(uint32_t front, uint32_t back)
+{
+    return ((uint64_t)back << 32) | front;
+}
+
+static bool
+PopFront(JobQueue& queue, uint32_t& o_Job)
+{
+    uint64_t range = queue.range.load(std::memory_order_acquire);
+    for (;;)
+    {
+        const uint32_t front = (uint32_t)range;
+        const uint32_t back = (uint32_t)(range >> 32);
+        if (front >= back)
+            return false;
+        if (queue.range.compare_exchange_weak(range, MakeJobRange(front + 1, back), std::memory_order_acq_rel,
+                                              std::memory_order_acquire))
+        {
+            o_Job = queue.jobs[front];
+            return true;
+        }
+    }
+}
+
+static bool
+PopBack(JobQueue& queue, uint32_t& o_Job)
+{
+    uint64_t range = queue.range.load(std::memory_order_acquire);
+    for (;;)
+    {
+        const uint32_t front = (uint32_t)range;
+        const uint32_t back = (uint32_t)(range >> 32);
+        if (front >= back)
+            return false;
+        if (queue.range.compare_exchange_weak(range, MakeJobRange(front, back - 1), std::memory_order_acq_rel,
+                                              std::memory_order_acquire))
+        {
+            o_Job = queue.jobs[back - 1];
+            return true;
+        }
+    }
+}
+
+// Steals one job from the worker with the most jobs left, from the back of its queue: the owner keeps working
+// on the front, on data next to what it has just recorded. Fails when all queues are empty.
+static bool
+Steal(JobSystem& js, uint32_t threadIndex, uint32_t& o_Job)
+{
+    for (;;)
+    {
+        uint32_t victim = UINT32_MAX;
+        uint32_t victimJobs = 0;
+        for (uint32_t t = 0; t < js.numThreads; ++t)
+        {
+            const uint64_t range = js.queues[t].range.load(std::memory_order_relaxed);
+            const uint32_t numJobs = (uint32_t)(range >> 32) - std::min((uint32_t)range, (uint32_t)(range >> 32));
+            if (t != threadIndex && numJobs > victimJobs)
+            {
+                victim = t;
+                victimJobs = numJobs;
+            }
+        }
+        if (victim == UINT32_MAX)
+            return false;
+        if (PopBack(js.queues[victim], o_Job))
+            return true;
+    }
+}
+
+static void
+RunJobWorker(void* context, uint32_t threadIndex)
+{
+    JobSystem& js = *(JobSystem*)context;
+    JobWorkerStats& stats = js.stats[threadIndex];
+    stats = {};
+
+    for (;;)
+    {
+        uint32_t job;
+        if (!PopFront(js.queues[threadIndex], job))
+        {
+            if (!Steal(js, threadIndex, job))
+                break;
+            stats.numSteals++;
+        }
+        if (js.affinity)
+            js.affinity[job] = (uint8_t)threadIndex;
+        const double begin = GetTime();
+        js.function(js.context, job, threadIndex);
+        stats.busy += GetTime() - begin;
+        stats.numJobs++;
+    }
+    stats.finishTime = GetTime();
+}
+
+void
+InitializeJobSystem(JobSystem& js, Workers* workers, uint32_t numThreads)
+{
+    js.workers = workers;
+    js.numThreads = numThreads;
+    js.numRuns = 0;
+    memset(js.totals, 0, sizeof(js.totals));
+}
+
+static inline uint32_t
+GetDefaultJobWorker(uint32_t jobIndex, uint32_t numJobs, uint32_t numThreads)
+{
+    return (uint32_t)((uint64_t)jobIndex * numThreads / numJobs);
+}
+
+void
+InitializeJobAffinity(uint8_t* affinity, uint32_t numJobs, uint32_t numThreads)
+{
+    for (uint32_t i = 0; i < numJobs; ++i)
+        affinity[i] = (uint8_t)GetDefaultJobWorker(i, numJobs, numThreads);
+}
+
+void
+RunJobs(JobSystem& js, JobFunction function, void* context, uint32_t numJobs, uint8_t* affinity)
+{
+    assert(numJobs <= k_MaxNumJobs);
+    js.function = function;
+    js.context = context;
+    js.affinity = affinity;
+
+    // Queues are filled before the workers are woken up, RunWorkers() publishes them.
+    uint32_t numQueued[k_MaxNumThreads] = {};
+    for (uint32_t i = 0; i < numJobs; ++i)
+    {
+        const uint32_t t = affinity ? affinity[i] % js.numThreads : GetDefaultJobWorker(i, numJobs, js.numThreads);
+        js.queues[t].jobs[numQueued[t]++] = i;
+    }
+    for (uint32_t t = 0; t < js.numThreads; ++t)
+        js.queues[t].range.store(MakeJobRange(0, numQueued[t]), std::memory_order_relaxed);
+
+    js.beginTime = GetTime();
+    RunWorkers(*js.workers, RunJobWorker, &js);
+    const double endTime = GetTime();
+
+    // Tail: how long a worker had nothing left to do while another one was still running its last job.
+    double lastFinishTime = 0.0;
+    for (uint32_t t = 0; t < js.numThreads; ++t)
+        lastFinishTime = std::max(lastFinishTime, js.stats[t].finishTime);
+    for (uint32_t t = 0; t < js.numThreads; ++t)
+    {
+        JobWorkerStats& stats = js.stats[t];
+        stats.idle = (endTime - js.beginTime) - stats.busy;
+        stats.tail = lastFinishTime - stats.finishTime;
+        js.totals[t].numJobs += stats.numJobs;
+        js.totals[t].numSteals += stats.numSteals;
+        js.totals[t].busy += stats.busy;
+        js.totals[t].idle += stats.idle;
+        js.totals[t].tail += stats.tail;
+    }
+    js.numRuns++;
+}
+
+void
+GetJobStats(const JobSystem& js, FrameTimings& o_Timings)
+{
+    double busy = 0.0, maxBusy = 0.0;
+    o_Timings.jobSteals = 0.0;
+    o_Timings.jobIdle = 0.0;
+    for (uint32_t t = 0; t < js.numThreads; ++t)
+    {
+        o_Timings.jobSteals += js.stats[t].numSteals;
+        o_Timings.jobIdle += js.stats[t].idle;
+        busy += js.stats[t].busy;
+        maxBusy = std::max(maxBusy, js.stats[t].busy);
+    }
+    o_Timings.jobImbalance = busy > 0.0 ? maxBusy / (busy / js.numThreads) - 1.0 : 0.0;
+}
+
+void
+PrintJobStats(const JobSystem& js)
+{
+    const double scale = 1.0 / std::max(1ull, (unsigned long long)js.numRuns);
+    for (uint32_t t = 0; t < js.numThreads; ++t)
+    {
+        const JobWorkerStats& totals = js.totals[t];
+        printf("jobs: worker=%u jobs_per_frame=%.1f steals_per_frame=%.1f busy_ms=%.3f idle_ms=%.3f tail_ms=%.3f\n",
+               t, totals.numJobs * scale, totals.numSteals * scale, totals.busy * scale * 1000.0,
+               totals.idle * scale * 1000.0, totals.tail * scale * 1000.0);
+    }
+}
+// vim: set ts=4 sw=4 expandtab:
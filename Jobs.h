@@ -0,0 +1,63 @@
+#pragma once
+#include "Common.h"
+#include <atomic>
+
+#define k_MaxNumJobs 1024
+
+typedef void (*JobFunction)(void* context, uint32_t jobIndex, uint32_t threadIndex);
+
+// Jobs queued for one worker. The owner takes jobs from the front, thieves take them from the back. Both ends
+// are packed into one 64-bit word that is only changed with compare-and-swap, neither side takes a lock.
+struct alignas(64) JobQueue
+{
+    std::atomic<uint64_t> range;        // front in the low, back in the high 32 bits, indices into 'jobs'
+    uint32_t jobs[k_MaxNumJobs];
+};
+
+// One worker, one RunJobs() call.
+struct alignas(64) JobWorkerStats
+{
+    uint32_t numJobs;
+    uint32_t numSteals;
+    double busy;                        // seconds spent running jobs
+    double idle;                        // seconds in RunJobs() not running jobs (wake up, stealing, waiting)
+    double finishTime;                  // when the worker found no job left to run or steal
+    double tail;                        // seconds from finishTime to the last worker's finishTime
+};
+
+// Work-stealing scheduler on top of the Workers pool: RunJobs() wakes all workers once, every worker runs the
+// jobs queued for it and then steals from the worker with the most jobs left until all queues are empty.
+struct JobSystem
+{
+    Workers* workers;
+    uint32_t numThreads;
+    JobFunction function;
+    void* context;
+    uint8_t* affinity;                  // of the current RunJobs() call, optional
+    double beginTime;
+    JobQueue queues[k_MaxNumThreads];
+    JobWorkerStats stats[k_MaxNumThreads];
+    JobWorkerStats totals[k_MaxNumThreads];    // sums over all RunJobs() calls
+    uint64_t numRuns;
+};
+
+// Draws per recording job for 'requested' draws per job (-jobsize), raised so that the draws fit into
+// k_MaxNumJobs jobs. 0 (no jobs) stays 0.
+static inline uint32_t
+GetRecordJobSize(uint32_t requested, uint32_t numDraws)
+{
+    return requested ? std::max(requested, (numDraws + k_MaxNumJobs - 1) / k_MaxNumJobs) : 0;
+}
+
+void InitializeJobSystem(JobSystem& js, Workers* workers, uint32_t numThreads);
+// Queues consecutive jobs for the same worker (contiguous blocks, like GetDrawRange()), the default of RunJobs().
+void InitializeJobAffinity(uint8_t* affinity, uint32_t numJobs, uint32_t numThreads);
+// Runs jobs [0, numJobs) and returns when all are done. 'affinity' is optional: on input the worker job i is
+// queued for, on return the worker that ran it. Passing the same array again keeps every job on the worker
+// that ran it last time, together with the data the job touched, unless it gets stolen.
+void RunJobs(JobSystem& js, JobFunction function, void* context, uint32_t numJobs, uint8_t* affinity = nullptr);
+// Steals, idle time (all workers) and load imbalance (max / mean busy time - 1) of the last RunJobs() call.
+void GetJobStats(const JobSystem& js, FrameTimings& o_Timings);
+// Prints jobs, steals, busy, idle and tail time per worker and RunJobs() call.
+void PrintJobStats(const JobSystem& js);
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,102 @@
+#pragma once
+#include "Common.h"
+#include "Random.h"
+
+// Particles move inside the box positions are generated in and bounce off its sides.
+#define k_ParticleBound 0.7f
+#define k_MaxParticleSpeed 0.5f     // box units per second
+#define k_ParticleTimeStep (1.0f / 60.0f)
+
+// Moves particles [0, count) by velocity * timeStep. A particle that leaves the box is reflected back into it
+// and its velocity component is negated (timeStep * speed must be less than the box size). Built for the
+// instruction set Random.h selected; every path does the same operations in the same order, so particles
+// with equal state stay equal whichever lane or path moves them (redundant draws rely on it). Returns the
+// number of bounces.
+static inline uint32_t
+IntegrateParticles(float* positionX, float* positionY, float* velocityX, float* velocityY, uint32_t count,
+                   float timeStep)
+{
+    float* positions[2] = { positionX, positionY };
+    float* velocities[2] = { velocityX, velocityY };
+    uint32_t numBounces = 0;
+
+    for (uint32_t axis = 0; axis < 2; ++axis)
+    {
+        float* p = positions[axis];
+        float* v = velocities[axis];
+        uint32_t i = 0;
+
+#if defined RANDOM_AVX2
+        const __m256 dt = _mm256_set1_ps(timeStep);
+        const __m256 hi = _mm256_set1_ps(k_ParticleBound);
+        const __m256 lo = _mm256_set1_ps(-k_ParticleBound);
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 vel = _mm256_loadu_ps(v + i);
+            const __m256 pos = _mm256_add_ps(_mm256_loadu_ps(p + i), _mm256_mul_ps(vel, dt));
+            const __m256 above = _mm256_cmp_ps(pos, hi, _CMP_GT_OQ);
+            const __m256 outside = _mm256_or_ps(above, _mm256_cmp_ps(pos, lo, _CMP_LT_OQ));
+            const __m256 bound = _mm256_blendv_ps(lo, hi, above);
+            const __m256 reflected = _mm256_sub_ps(_mm256_add_ps(bound, bound), pos);
+            _mm256_storeu_ps(p + i, _mm256_blendv_ps(pos, reflected, outside));
+            _mm256_storeu_ps(v + i, _mm256_xor_ps(vel, _mm256_and_ps(outside, sign)));
+            numBounces += PopCount64((uint64_t)_mm256_movemask_ps(outside));
+        }
+#elif defined RANDOM_SSE2
+        const __m128 dt = _mm_set1_ps(timeStep);
+        const __m128 hi = _mm_set1_ps(k_ParticleBound);
+        const __m128 lo = _mm_set1_ps(-k_ParticleBound);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 vel = _mm_loadu_ps(v + i);
+            const __m128 pos = _mm_add_ps(_mm_loadu_ps(p + i), _mm_mul_ps(vel, dt));
+            const __m128 above = _mm_cmpgt_ps(pos, hi);
+            const __m128 outside = _mm_or_ps(above, _mm_cmplt_ps(pos, lo));
+            const __m128 bound = _mm_or_ps(_mm_and_ps(above, hi), _mm_andnot_ps(above, lo));
+            const __m128 reflected = _mm_sub_ps(_mm_add_ps(bound, bound), pos);
+            _mm_storeu_ps(p + i, _mm_or_ps(_mm_and_ps(outside, reflected), _mm_andnot_ps(outside, pos)));
+            _mm_storeu_ps(v + i, _mm_xor_ps(vel, _mm_and_ps(outside, sign)));
+            numBounces += PopCount64((uint64_t)_mm_movemask_ps(outside));
+        }
+#elif defined RANDOM_NEON
+        const float32x4_t dt = vdupq_n_f32(timeStep);
+        const float32x4_t hi = vdupq_n_f32(k_ParticleBound);
+        const float32x4_t lo = vdupq_n_f32(-k_ParticleBound);
+        const uint32x4_t sign = vdupq_n_u32(0x80000000u);
+        for (; i + 4 <= count; i += 4)
+        {
+            const float32x4_t vel = vld1q_f32(v + i);
+            const float32x4_t pos = vaddq_f32(vld1q_f32(p + i), vmulq_f32(vel, dt));
+            const uint32x4_t above = vcgtq_f32(pos, hi);
+            const uint32x4_t outside = vorrq_u32(above, vcltq_f32(pos, lo));
+            const float32x4_t bound = vbslq_f32(above, hi, lo);
+            const float32x4_t reflected = vsubq_f32(vaddq_f32(bound, bound), pos);
+            vst1q_f32(p + i, vbslq_f32(outside, reflected, pos));
+            const uint32x4_t flipped = veorq_u32(vreinterpretq_u32_f32(vel), vandq_u32(outside, sign));
+            vst1q_f32(v + i, vreinterpretq_f32_u32(flipped));
+            const uint32x4_t bounces = vshrq_n_u32(outside, 31);
+            numBounces += vgetq_lane_u32(bounces, 0) + vgetq_lane_u32(bounces, 1) + vgetq_lane_u32(bounces, 2) +
+                          vgetq_lane_u32(bounces, 3);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            const float pos = p[i] + v[i] * timeStep;
+            if (pos > k_ParticleBound || pos < -k_ParticleBound)
+            {
+                const float bound = pos > k_ParticleBound ? k_ParticleBound : -k_ParticleBound;
+                p[i] = (bound + bound) - pos;
+                v[i] = -v[i];
+                numBounces++;
+            }
+            else
+            {
+                p[i] = pos;
+            }
+        }
+    }
+    return numBounces;
+}
+// vim: set ts=4 sw=4 expandtab:
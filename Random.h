@@ -0,0 +1,181 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RANDOM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RANDOM_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RANDOM_NEON
+#endif
+
+// Eight interleaved xorshift128 generators. Every SIMD path (and the scalar tail) steps the lanes with the
+// same operations, so a stream produces the same numbers on every ISA. Not thread-safe, use one stream per
+// thread.
+struct RandomStream
+{
+    alignas(32) uint32_t x[8];
+    alignas(32) uint32_t y[8];
+    alignas(32) uint32_t z[8];
+    alignas(32) uint32_t w[8];
+};
+
+static inline const char*
+GetRandomIsaName()
+{
+#if defined RANDOM_AVX2
+    return "avx2";
+#elif defined RANDOM_SSE2
+    return "sse2";
+#elif defined RANDOM_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+static inline uint64_t
+SplitMix64(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline void
+SeedRandom(RandomStream& stream, uint64_t seed)
+{
+    for (uint32_t lane = 0; lane < 8; ++lane)
+    {
+        stream.x[lane] = (uint32_t)SplitMix64(seed);
+        stream.y[lane] = (uint32_t)SplitMix64(seed);
+        stream.z[lane] = (uint32_t)SplitMix64(seed);
+        stream.w[lane] = (uint32_t)SplitMix64(seed) | 1; // state must not be all zeros
+    }
+}
+
+// Fills 'out' with 'count' floats in [begin, end) (23 random bits each).
+static inline void
+FillRandom(RandomStream& stream, float* out, uint32_t count, float begin, float end)
+{
+    // [1.0f, 2.0f) * scale + bias == [begin, end)
+    const float scale = end - begin;
+    const float bias = begin - scale;
+    uint32_t i = 0;
+
+#if defined RANDOM_AVX2
+    __m256i x = _mm256_load_si256((const __m256i*)stream.x);
+    __m256i y = _mm256_load_si256((const __m256i*)stream.y);
+    __m256i z = _mm256_load_si256((const __m256i*)stream.z);
+    __m256i w = _mm256_load_si256((const __m256i*)stream.w);
+    const __m256i one = _mm256_set1_epi32(0x3f800000);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vbias = _mm256_set1_ps(bias);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i t = _mm256_xor_si256(x, _mm256_slli_epi32(x, 11));
+        x = y;
+        y = z;
+        z = w;
+        w = _mm256_xor_si256(_mm256_xor_si256(w, _mm256_srli_epi32(w, 19)), _mm256_xor_si256(t, _mm256_srli_epi32(t, 8)));
+        const __m256 f = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(w, 9), one));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(f, vscale), vbias));
+    }
+    _mm256_store_si256((__m256i*)stream.x, x);
+    _mm256_store_si256((__m256i*)stream.y, y);
+    _mm256_store_si256((__m256i*)stream.z, z);
+    _mm256_store_si256((__m256i*)stream.w, w);
+#elif defined RANDOM_SSE2
+    __m128i x[2], y[2], z[2], w[2];
+    for (uint32_t h = 0; h < 2; ++h)
+    {
+        x[h] = _mm_load_si128((const __m128i*)stream.x + h);
+        y[h] = _mm_load_si128((const __m128i*)stream.y + h);
+        z[h] = _mm_load_si128((const __m128i*)stream.z + h);
+        w[h] = _mm_load_si128((const __m128i*)stream.w + h);
+    }
+    const __m128i one = _mm_set1_epi32(0x3f800000);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vbias = _mm_set1_ps(bias);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        for (uint32_t h = 0; h < 2; ++h)
+        {
+            const __m128i t = _mm_xor_si128(x[h], _mm_slli_epi32(x[h], 11));
+            x[h] = y[h];
+            y[h] = z[h];
+            z[h] = w[h];
+            w[h] = _mm_xor_si128(_mm_xor_si128(w[h], _mm_srli_epi32(w[h], 19)), _mm_xor_si128(t, _mm_srli_epi32(t, 8)));
+            const __m128 f = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(w[h], 9), one));
+            _mm_storeu_ps(out + i + h * 4, _mm_add_ps(_mm_mul_ps(f, vscale), vbias));
+        }
+    }
+    for (uint32_t h = 0; h < 2; ++h)
+    {
+        _mm_store_si128((__m128i*)stream.x + h, x[h]);
+        _mm_store_si128((__m128i*)stream.y + h, y[h]);
+        _mm_store_si128((__m128i*)stream.z + h, z[h]);
+        _mm_store_si128((__m128i*)stream.w + h, w[h]);
+    }
+#elif defined RANDOM_NEON
+    uint32x4_t x[2], y[2], z[2], w[2];
+    for (uint32_t h = 0; h < 2; ++h)
+    {
+        x[h] = vld1q_u32(stream.x + h * 4);
+        y[h] = vld1q_u32(stream.y + h * 4);
+        z[h] = vld1q_u32(stream.z + h * 4);
+        w[h] = vld1q_u32(stream.w + h * 4);
+    }
+    const uint32x4_t one = vdupq_n_u32(0x3f800000);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const float32x4_t vbias = vdupq_n_f32(bias);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        for (uint32_t h = 0; h < 2; ++h)
+        {
+            const uint32x4_t t = veorq_u32(x[h], vshlq_n_u32(x[h], 11));
+            x[h] = y[h];
+            y[h] = z[h];
+            z[h] = w[h];
+            w[h] = veorq_u32(veorq_u32(w[h], vshrq_n_u32(w[h], 19)), veorq_u32(t, vshrq_n_u32(t, 8)));
+            const float32x4_t f = vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(w[h], 9), one));
+            vst1q_f32(out + i + h * 4, vaddq_f32(vmulq_f32(f, vscale), vbias));
+        }
+    }
+    for (uint32_t h = 0; h < 2; ++h)
+    {
+        vst1q_u32(stream.x + h * 4, x[h]);
+        vst1q_u32(stream.y + h * 4, y[h]);
+        vst1q_u32(stream.z + h * 4, z[h]);
+        vst1q_u32(stream.w + h * 4, w[h]);
+    }
+#endif
+
+    // Scalar path: the tail, or everything when there is no SIMD support.
+    for (; i < count; i += 8)
+    {
+        for (uint32_t lane = 0; lane < 8; ++lane)
+        {
+            const uint32_t t = stream.x[lane] ^ (stream.x[lane] << 11);
+            stream.x[lane] = stream.y[lane];
+            stream.y[lane] = stream.z[lane];
+            stream.z[lane] = stream.w[lane];
+            stream.w[lane] = stream.w[lane] ^ (stream.w[lane] >> 19) ^ (t ^ (t >> 8));
+            if (i + lane < count)
+            {
+                const uint32_t bits = (stream.w[lane] >> 9) | 0x3f800000;
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                out[i + lane] = f * scale + bias;
+            }
+        }
+    }
+}
+// vim: set ts=4 sw=4 expandtab:
@@ -0,0 +1,216 @@
+#include "Scene.h"
+#include "Particles.h"
+
+void
+GeneratePositions(RandomStream& stream, uint64_t redundantDrawThreshold, float* positionX, float* positionY,
+                  uint32_t begin, uint32_t end)
+{
+    FillRandom(stream, positionX + begin, end - begin, -0.7f, 0.7f);
+    FillRandom(stream, positionY + begin, end - begin, -0.7f, 0.7f);
+
+    for (uint32_t i = begin + 1; redundantDrawThreshold != 0 && i < end; ++i)
+    {
+        if (IsRedundantDraw(i, redundantDrawThreshold))
+        {
+            positionX[i] = positionX[i - 1];
+            positionY[i] = positionY[i - 1];
+        }
+    }
+}
+
+// Every thread fills its draw range from its own random stream.
+static void
+GenerateSceneRange(void* context, uint32_t threadIndex)
+{
+    Scene& scene = *(Scene*)context;
+
+    uint32_t begin, end;
+    GetDrawRange(scene.numDraws, scene.numThreads, threadIndex, begin, end);
+    GeneratePositions(scene.streams[threadIndex], scene.redundantDrawThreshold, scene.positionX.data(),
+                      scene.positionY.data(), begin, end);
+}
+
+// Velocities are generated like positions, redundant draws repeat the velocity of the previous draw as well
+// so that both particles stay in the same place.
+static void
+GenerateVelocityRange(void* context, uint32_t threadIndex)
+{
+    Scene& scene = *(Scene*)context;
+    float* velocityX = scene.velocityX.data();
+    float* velocityY = scene.velocityY.data();
+
+    uint32_t begin, end;
+    GetDrawRange(scene.numDraws, scene.numThreads, threadIndex, begin, end);
+    FillRandom(scene.streams[threadIndex], velocityX + begin, end - begin, -k_MaxParticleSpeed, k_MaxParticleSpeed);
+    FillRandom(scene.streams[threadIndex], velocityY + begin, end - begin, -k_MaxParticleSpeed, k_MaxParticleSpeed);
+
+    for (uint32_t i = begin + 1; scene.redundantDrawThreshold != 0 && i < end; ++i)
+    {
+        if (IsRedundantDraw(i, scene.redundantDrawThreshold))
+        {
+            velocityX[i] = velocityX[i - 1];
+            velocityY[i] = velocityY[i - 1];
+        }
+    }
+}
+
+// Fixed time step, every run integrates the same trajectories whatever the frame rate.
+static void
+IntegrateSceneRange(void* context, uint32_t threadIndex)
+{
+    Scene& scene = *(Scene*)context;
+
+    uint32_t begin, end;
+    GetDrawRange(scene.numDraws, scene.numThreads, threadIndex, begin, end);
+    scene.threads[threadIndex].numBounces +=
+        IntegrateParticles(scene.positionX.data() + begin, scene.positionY.data() + begin,
+                           scene.velocityX.data() + begin, scene.velocityY.data() + begin, end - begin,
+                           k_ParticleTimeStep);
+}
+
+// Threads own whole bitset words, draw ranges start at multiples of 64. Moved objects of a word get positions
+// from one 64-wide batch of random numbers.
+static void
+MoveSceneRange(void* context, uint32_t threadIndex)
+{
+    Scene& scene = *(Scene*)context;
+    SceneThread& thread = scene.threads[threadIndex];
+    RandomStream& stream = scene.streams[threadIndex];
+    uint64_t* moved = scene.moved[scene.frame % scene.numFramesInFlight].data();
+    float* positionX = scene.positionX.data();
+    float* positionY = scene.positionY.data();
+    const uint32_t salt = HashUint32((uint32_t)scene.frame);
+
+    uint32_t wordBegin, wordEnd;
+    GetDrawRange(scene.numWords, scene.numThreads, threadIndex, wordBegin, wordEnd);
+
+    for (uint32_t w = wordBegin; w < wordEnd; ++w)
+    {
+        const uint32_t first = w * 64;
+        const uint32_t count = std::min(64u, scene.numDraws - first);
+        uint64_t mask = 0;
+        for (uint32_t j = 0; j < count; ++j)
+            mask |= (uint64_t)(HashUint32((first + j) ^ salt) < scene.dynamicThreshold) << j;
+        moved[w] = mask;
+        if (mask == 0)
+            continue;
+
+        float x[64], y[64];
+        FillRandom(stream, x, 64, -0.7f, 0.7f);
+        FillRandom(stream, y, 64, -0.7f, 0.7f);
+        for (uint64_t bits = mask; bits != 0; bits &= bits - 1)
+        {
+            const uint32_t j = (uint32_t)CountTrailingZeros64(bits);
+            positionX[first + j] = x[j];
+            positionY[first + j] = y[j];
+        }
+    }
+
+    // Redundant draws keep the position of the previous draw of the range: when either has moved, the redundant
+    // one takes the new position.
+    const uint32_t begin = wordBegin * 64;
+    const uint32_t end = std::min(wordEnd * 64, scene.numDraws);
+    for (uint32_t i = begin + 1; scene.redundantDrawThreshold != 0 && i < end; ++i)
+    {
+        if (IsRedundantDraw(i, scene.redundantDrawThreshold) &&
+            (IsDrawDirty(moved, i - 1) || IsDrawDirty(moved, i)))
+        {
+            positionX[i] = positionX[i - 1];
+            positionY[i] = positionY[i - 1];
+            moved[i >> 6] |= 1ull << (i & 63);
+        }
+    }
+
+    // Data of a frame in flight that is used for the first time has never been written, all of it is stale.
+    const bool firstUse = scene.frame < scene.numFramesInFlight;
+    uint64_t numMoved = 0, numStale = 0;
+    for (uint32_t w = wordBegin; w < wordEnd; ++w)
+    {
+        const uint32_t count = std::min(64u, scene.numDraws - w * 64);
+        uint64_t stale = firstUse ? (count == 64 ? ~0ull : (1ull << count) - 1) : 0;
+        for (uint32_t f = 0; f < scene.numFramesInFlight; ++f)
+            stale |= scene.moved[f][w];
+        scene.stale[w] = stale;
+        numMoved += PopCount64(moved[w]);
+        numStale += PopCount64(stale);
+    }
+    thread.numMoved += numMoved;
+    thread.numStale += numStale;
+}
+
+void
+InitializeScene(Scene& scene, const Config& config, Workers& workers, RandomStream* streams)
+{
+    scene.numDraws = config.numDraws;
+    scene.numWords = (config.numDraws + 63) / 64;
+    scene.numThreads = config.numThreads;
+    scene.numFramesInFlight = std::max(1u, config.numFramesInFlight);
+    scene.streams = streams;
+    scene.redundantDrawThreshold = GetRedundantDrawThreshold(config.redundancy);
+    scene.dynamic = config.dynamic;
+    scene.dynamicThreshold = (uint32_t)(std::min(std::max(config.dynamic, 0.0), 1.0) * 4294967295.0);
+    scene.particles = config.particles;
+    scene.frame = 0;
+    scene.numFrames = 0;
+    memset(scene.threads, 0, sizeof(scene.threads));
+
+    scene.positionX.resize(scene.numDraws);
+    scene.positionY.resize(scene.numDraws);
+    RunWorkers(workers, GenerateSceneRange, &scene);
+    if (scene.particles)
+    {
+        scene.velocityX.resize(scene.numDraws);
+        scene.velocityY.resize(scene.numDraws);
+        RunWorkers(workers, GenerateVelocityRange, &scene);
+    }
+
+    // Only the partial update uses the bitsets.
+    const uint32_t numWords = config.dynamic < 1.0 && !scene.particles ? scene.numWords : 0;
+    for (uint32_t f = 0; f < k_MaxNumFramesInFlight; ++f)
+        scene.moved[f].assign(numWords, 0);
+    scene.stale.assign(numWords, 0);
+}
+
+const uint64_t*
+UpdateScene(Scene& scene, Workers& workers)
+{
+    if (scene.particles)
+    {
+        RunWorkers(workers, IntegrateSceneRange, &scene);
+        scene.numFrames++;
+        return nullptr;
+    }
+    if (scene.dynamic >= 1.0)
+    {
+        RunWorkers(workers, GenerateSceneRange, &scene);
+        return nullptr;
+    }
+    RunWorkers(workers, MoveSceneRange, &scene);
+    scene.frame++;
+    scene.numFrames++;
+    return scene.stale.data();
+}
+
+void
+PrintSceneStats(const Scene& scene)
+{
+    if (scene.dynamic >= 1.0 && !scene.particles)
+        return;
+    uint64_t numMoved = 0, numStale = 0, numBounces = 0;
+    for (uint32_t t = 0; t < scene.numThreads; ++t)
+    {
+        numMoved += scene.threads[t].numMoved;
+        numStale += scene.threads[t].numStale;
+        numBounces += scene.threads[t].numBounces;
+    }
+    const double scale = 1.0 / std::max(1ull, (unsigned long long)scene.numFrames);
+    if (scene.particles)
+    {
+        printf("scene: particles=%u isa=%s bounces_per_frame=%.0f\n", scene.numDraws, GetRandomIsaName(),
+               numBounces * scale);
+        return;
+    }
+    printf("scene: dynamic=%.4f moved_per_frame=%.0f stale_per_frame=%.0f\n", scene.dynamic, numMoved * scale,
+           numStale * scale);
+}
+// vim: set ts=4 sw=4 expandtab:
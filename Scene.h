@@ -0,0 +1,53 @@
+#pragma once
+#include "Common.h"
+#include "Random.h"
+
+// Written only by its thread.
+struct alignas(64) SceneThread
+{
+    uint64_t numMoved;
+    uint64_t numStale;
+    uint64_t numBounces;
+};
+
+// Persistent scene, one object per draw, positions in structure-of-arrays form updated in place. Every frame a
+// fraction 'dynamic' of the objects moves (a new random position), the others keep theirs. Objects moved in a
+// frame are set in its bitset of 'moved'. Backends keep one copy of per-draw data per frame in flight, the copy
+// of the current frame was written numFramesInFlight frames ago: 'stale', the union of the last
+// numFramesInFlight 'moved' bitsets, are the objects whose data in it is out of date (FrameData::dirty). In the
+// first numFramesInFlight frames all objects are stale. With 'dynamic' 1 every object is regenerated every
+// frame, there is no bitset. With 'particles' every object has a velocity instead and all of them are moved
+// by IntegrateParticles() (Particles.h) every frame.
+struct Scene
+{
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> velocityX;                           // particles only
+    std::vector<float> velocityY;
+    std::vector<uint64_t> moved[k_MaxNumFramesInFlight];   // ring, frame % numFramesInFlight
+    std::vector<uint64_t> stale;
+    SceneThread threads[k_MaxNumThreads];
+    RandomStream* streams;                                  // one per thread
+    uint64_t redundantDrawThreshold;
+    double dynamic;
+    uint32_t dynamicThreshold;                              // object moves if its hash is below it
+    bool particles;
+    uint32_t numDraws;
+    uint32_t numWords;
+    uint32_t numThreads;
+    uint32_t numFramesInFlight;
+    uint64_t frame;
+    uint64_t numFrames;                                     // partial or particle updates, for the stats
+};
+
+// Fills positions of draws [begin, end) from 'stream'. Redundant draws (IsRedundantDraw()) repeat the position
+// of the previous draw of the range.
+void GeneratePositions(RandomStream& stream, uint64_t redundantDrawThreshold, float* positionX, float* positionY,
+                       uint32_t begin, uint32_t end);
+// Generates all positions, and velocities of particles.
+void InitializeScene(Scene& scene, const Config& config, Workers& workers, RandomStream* streams);
+// Moves this frame's objects. Returns the stale bitset, nullptr when every object has moved (also particles).
+const uint64_t* UpdateScene(Scene& scene, Workers& workers);
+// Prints moved and stale objects (bounces of particles) per frame, call once after the last frame.
+void PrintSceneStats(const Scene& scene);
+// vim: set ts=4 sw=4 expandtab:
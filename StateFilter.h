@@ -0,0 +1,86 @@
+#pragma once
+#include "Common.h"
+
+#define k_MaxFilteredRootParameters 4
+#define k_MaxFilteredRootConstants 16
+
+// Recorder that keeps a shadow copy of the pipeline state, root signature, primitive topology and root
+// constants set on a command list and drops calls that would not change them. Root constants are compared
+// value by value, a write is dropped only if every value it sets is already known to be equal. The shadow
+// starts from the state BeginCommandList() has set (Reset()); calls it doesn't filter are not forwarded, only
+// the per-draw calls of the recording loops are.
+template <typename CommandList, typename PipelineState, typename RootSignature, typename Topology>
+struct StateFilterCommandList
+{
+    CommandList* cl;
+    PipelineState pipelineState;
+    RootSignature rootSignature;
+    Topology topology;
+    uint32_t rootConstants[k_MaxFilteredRootParameters][k_MaxFilteredRootConstants];
+    uint32_t validRootConstants[k_MaxFilteredRootParameters];   // bit i set: rootConstants[..][i] is known
+
+    void
+    Reset(CommandList* commandList, PipelineState pso, RootSignature rootSig, Topology primitiveTopology)
+    {
+        cl = commandList;
+        pipelineState = pso;
+        rootSignature = rootSig;
+        topology = primitiveTopology;
+        memset(validRootConstants, 0, sizeof(validRootConstants));
+    }
+
+    void
+    SetPipelineState(PipelineState pso)
+    {
+        if (pso == pipelineState)
+            return;
+        pipelineState = pso;
+        cl->SetPipelineState(pso);
+    }
+
+    // Root arguments are reset when the root signature changes.
+    void
+    SetGraphicsRootSignature(RootSignature rootSig)
+    {
+        if (rootSig == rootSignature)
+            return;
+        rootSignature = rootSig;
+        memset(validRootConstants, 0, sizeof(validRootConstants));
+        cl->SetGraphicsRootSignature(rootSig);
+    }
+
+    void
+    IASetPrimitiveTopology(Topology primitiveTopology)
+    {
+        if (primitiveTopology == topology)
+            return;
+        topology = primitiveTopology;
+        cl->IASetPrimitiveTopology(primitiveTopology);
+    }
+
+    void
+    SetGraphicsRoot32BitConstants(uint32_t rootIndex, uint32_t num32BitValues, const void* srcData, uint32_t destOffset)
+    {
+        if (rootIndex >= k_MaxFilteredRootParameters || destOffset + num32BitValues > k_MaxFilteredRootConstants)
+        {
+            cl->SetGraphicsRoot32BitConstants(rootIndex, num32BitValues, srcData, destOffset);
+            return;
+        }
+
+        uint32_t* shadow = rootConstants[rootIndex] + destOffset;
+        const uint32_t mask = (uint32_t)(((1ull << num32BitValues) - 1) << destOffset);
+        if ((validRootConstants[rootIndex] & mask) == mask && memcmp(shadow, srcData, num32BitValues * 4) == 0)
+            return;
+        memcpy(shadow, srcData, num32BitValues * 4);
+        validRootConstants[rootIndex] |= mask;
+        cl->SetGraphicsRoot32BitConstants(rootIndex, num32BitValues, srcData, destOffset);
+    }
+
+    template <typename... Args>
+    void
+    DrawInstanced(Args... args)
+    {
+        cl->DrawInstanced(args...);
+    }
+};
+// vim: set ts=4 sw=4 expandtab:
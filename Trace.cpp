@@ -0,0 +1,73 @@
+#include "Trace.h"
+
+bool g_TraceEnabled;
+
+static double s_TraceStart;
+static std::atomic<uint32_t> s_NumTraceThreads;
+static TraceThread* s_TraceThreads[k_MaxNumTraceThreads];
+static thread_local TraceThread* s_CurrentTraceThread;
+
+void
+EnableTrace()
+{
+    s_TraceStart = GetTime();
+    g_TraceEnabled = true;
+    GetTraceThread(); // the calling thread is thread 0 ("main")
+}
+
+TraceThread*
+GetTraceThread()
+{
+    if (s_CurrentTraceThread)
+        return s_CurrentTraceThread;
+
+    const uint32_t id = s_NumTraceThreads.fetch_add(1, std::memory_order_relaxed);
+    if (id >= k_MaxNumTraceThreads)
+        return nullptr;
+
+    TraceThread* thread = new TraceThread();
+    thread->id = id;
+    s_TraceThreads[id] = thread;
+    s_CurrentTraceThread = thread;
+    return thread;
+}
+
+bool
+WriteTrace(const char* fileName)
+{
+    FILE* file = fopen(fileName, "w");
+    if (!file)
+        return false;
+
+    // Complete ('X') events, timestamps in microseconds since EnableTrace().
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    const uint32_t numThreads = std::min(s_NumTraceThreads.load(), (uint32_t)k_MaxNumTraceThreads);
+    for (uint32_t t = 0; t < numThreads; ++t)
+    {
+        const TraceThread* thread = s_TraceThreads[t];
+        if (!thread)
+            continue;
+
+        char threadName[32];
+        if (thread->id == 0)
+            snprintf(threadName, sizeof(threadName), "main");
+        else
+            snprintf(threadName, sizeof(threadName), "thread %u", thread->id);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", thread->id, threadName);
+        first = false;
+
+        const uint64_t count = thread->count.load(std::memory_order_acquire);
+        for (uint64_t i = count > k_TraceCapacity ? count - k_TraceCapacity : 0; i < count; ++i)
+        {
+            const TraceZoneRecord& zone = thread->zones[i % k_TraceCapacity];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    zone.name, thread->id, (zone.begin - s_TraceStart) * 1e6, (zone.end - zone.begin) * 1e6);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+// vim: set ts=4 sw=4 expandtab:
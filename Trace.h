@@ -0,0 +1,64 @@
+#pragma once
+#include "Common.h"
+#include <atomic>
+
+#define k_TraceCapacity (64 * 1024)     // zones kept per thread, the oldest ones are overwritten
+#define k_MaxNumTraceThreads 256        // zones of threads started after this many are dropped
+
+// One completed zone, times in seconds (GetTime()).
+struct TraceZoneRecord
+{
+    const char* name;                   // string literal, never copied
+    double begin;
+    double end;
+};
+
+// Ring of zones written by a single thread. The writer publishes with a release store of 'count', the trace
+// is written from another thread once the recording threads are idle.
+struct TraceThread
+{
+    uint32_t id;
+    std::atomic<uint64_t> count;
+    TraceZoneRecord zones[k_TraceCapacity];
+};
+
+extern bool g_TraceEnabled;
+
+// Zones are recorded only after EnableTrace().
+void EnableTrace();
+// Ring of the calling thread, created on first use. Returns nullptr when tracing is disabled or there are too
+// many threads.
+TraceThread* GetTraceThread();
+// Writes all recorded zones as a Chrome trace (JSON, opens in chrome://tracing and ui.perfetto.dev). Returns
+// false if the file can't be created.
+bool WriteTrace(const char* fileName);
+
+// Records the time between construction and destruction as a zone of the calling thread.
+struct TraceZone
+{
+    TraceThread* thread;
+    const char* name;
+    double begin;
+
+    explicit TraceZone(const char* zoneName)
+    {
+        thread = g_TraceEnabled ? GetTraceThread() : nullptr;
+        name = zoneName;
+        begin = thread ? GetTime() : 0.0;
+    }
+
+    ~TraceZone()
+    {
+        if (!thread)
+            return;
+        const uint64_t i = thread->count.load(std::memory_order_relaxed);
+        thread->zones[i % k_TraceCapacity] = { name, begin, GetTime() };
+        thread->count.store(i + 1, std::memory_order_release);
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+// Zone from this line to the end of the enclosing scope.
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+// vim: set ts=4 sw=4 expandtab:
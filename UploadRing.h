@@ -0,0 +1,111 @@
+#pragma once
+#include "Common.h"
+#include <atomic>
+
+#define k_UploadChunkSize (64 * 1024)
+#define k_ConstantBufferAlignment 256
+
+struct UploadAllocation
+{
+    uint8_t* cpuAddress;
+    uint64_t gpuAddress;
+};
+
+// Chunk a thread is currently suballocating from (ring positions). Aligned to a cache line so that threads
+// never write to the same line.
+struct alignas(64) UploadRingCursor
+{
+    uint64_t offset;
+    uint64_t end;
+};
+
+// Linear ring in a persistently mapped upload buffer, shared by all recording threads. Threads take
+// k_UploadChunkSize chunks with a single atomic add and suballocate from them without synchronization.
+// Memory of a frame is reclaimed once the GPU has passed the fence value the frame was submitted with.
+struct UploadRing
+{
+    uint8_t* cpuBase;
+    uint64_t gpuBase;
+    uint64_t size;                      // multiple of k_UploadChunkSize, chunks never wrap
+    std::atomic<uint64_t> head;         // monotonic position, offset in the buffer is head % size
+    uint64_t tail;                      // everything before it has been consumed by the GPU
+    // Submitted frames not yet known to be complete (FIFO): ring position at the end of the frame and the
+    // fence value that is signaled when the GPU is done with it.
+    uint64_t frameHead[k_MaxNumFramesInFlight + 1];
+    uint64_t frameFenceValue[k_MaxNumFramesInFlight + 1];
+    uint32_t firstFrame;
+    uint32_t numFrames;
+    UploadRingCursor cursors[k_MaxNumThreads];
+};
+
+// Size of a ring that holds 'numFrames' frames of 'bytesPerFrame' bytes recorded by 'numThreads' threads.
+// Every thread can leave one partly used chunk per frame.
+static inline uint64_t
+GetUploadRingSize(uint64_t bytesPerFrame, uint32_t numThreads, uint32_t numFrames)
+{
+    const uint64_t frameSize = bytesPerFrame + (uint64_t)(numThreads + 1) * k_UploadChunkSize;
+    return (frameSize * numFrames + k_UploadChunkSize - 1) / k_UploadChunkSize * k_UploadChunkSize;
+}
+
+static inline void
+InitializeUploadRing(UploadRing& ring, void* cpuBase, uint64_t gpuBase, uint64_t size)
+{
+    assert(size % k_UploadChunkSize == 0);
+    ring.cpuBase = (uint8_t*)cpuBase;
+    ring.gpuBase = gpuBase;
+    ring.size = size;
+    ring.head.store(0, std::memory_order_relaxed);
+    ring.tail = 0;
+    ring.firstFrame = 0;
+    ring.numFrames = 0;
+    for (UploadRingCursor& cursor : ring.cursors)
+        cursor = {};
+}
+
+// Called once per frame, before recording. Reclaims memory of frames whose fence value has been reached and
+// drops the chunks of the previous frame, a chunk never spans two frames.
+static inline void
+BeginUploadFrame(UploadRing& ring, uint64_t completedFenceValue)
+{
+    while (ring.numFrames > 0 && ring.frameFenceValue[ring.firstFrame] <= completedFenceValue)
+    {
+        ring.tail = ring.frameHead[ring.firstFrame];
+        ring.firstFrame = (ring.firstFrame + 1) % (k_MaxNumFramesInFlight + 1);
+        ring.numFrames--;
+    }
+    for (UploadRingCursor& cursor : ring.cursors)
+        cursor = {};
+}
+
+// Called once per frame, after all threads are done recording.
+static inline void
+EndUploadFrame(UploadRing& ring, uint64_t fenceValue)
+{
+    assert(ring.numFrames <= k_MaxNumFramesInFlight);
+    const uint32_t i = (ring.firstFrame + ring.numFrames) % (k_MaxNumFramesInFlight + 1);
+    ring.frameHead[i] = ring.head.load(std::memory_order_relaxed);
+    ring.frameFenceValue[i] = fenceValue;
+    ring.numFrames++;
+}
+
+// Thread-safe as long as every thread passes its own 'threadIndex'.
+static inline UploadAllocation
+AllocateUpload(UploadRing& ring, uint32_t threadIndex, uint32_t size, uint32_t alignment)
+{
+    assert(size <= k_UploadChunkSize && (alignment & (alignment - 1)) == 0);
+    UploadRingCursor& cursor = ring.cursors[threadIndex];
+
+    uint64_t offset = (cursor.offset + alignment - 1) & ~(uint64_t)(alignment - 1);
+    if (offset + size > cursor.end)
+    {
+        offset = ring.head.fetch_add(k_UploadChunkSize, std::memory_order_relaxed);
+        cursor.end = offset + k_UploadChunkSize;
+        // The ring is sized with GetUploadRingSize() and frames in flight are limited by Present().
+        assert(cursor.end - ring.tail <= ring.size && "upload ring is full");
+    }
+    cursor.offset = offset + size;
+
+    const uint64_t bufferOffset = offset % ring.size;
+    return { ring.cpuBase + bufferOffset, ring.gpuBase + bufferOffset };
+}
+// vim: set ts=4 sw=4 expandtab: